@@ -0,0 +1,31 @@
+#version 430
+
+in vec3 v2fColor;
+in vec3 v2fNormal;
+in vec2 v2fTexCoord;
+flat in uint v2fMaterial;
+
+layout( location = 2 ) uniform vec3 uLightDir;
+layout( location = 3 ) uniform vec3 uLightDiffuse;
+layout( location = 4 ) uniform vec3 uSceneAmbient;
+
+layout( binding = 0 ) uniform sampler2DArray uTextures;
+
+layout( std430, binding = 5 ) readonly buffer MaterialLayers { int layers[]; };
+
+layout( location = 0 ) out vec4 oColor;
+
+void main()
+{
+	vec3 normal = normalize( v2fNormal );
+	float nDotL = max( 0.0, dot( normal, uLightDir ) );
+
+	// Diffuse colour (Kd, in the vertex colour), modulated by the diffuse
+	// texture (map_Kd) if the material has one.
+	vec3 albedo = v2fColor;
+	int layer = layers[v2fMaterial];
+	if( layer >= 0 )
+		albedo *= texture( uTextures, vec3( v2fTexCoord, float(layer) ) ).rgb;
+
+	oColor = vec4( (uSceneAmbient + nDotL * uLightDiffuse) * albedo, 1.0 );
+}
@@ -0,0 +1,27 @@
+#version 430
+
+// Meshes created with create_vao(); see material.hpp.
+
+layout( location = 0 ) in vec3 iPosition;
+layout( location = 1 ) in vec3 iColor;
+layout( location = 2 ) in vec3 iNormal;
+layout( location = 3 ) in vec2 iTexCoord;
+layout( location = 4 ) in uint iMaterial;
+
+layout( location = 0 ) uniform mat4 uProjCameraWorld;
+layout( location = 1 ) uniform mat3 uNormalMatrix;
+
+out vec3 v2fColor;
+out vec3 v2fNormal;
+out vec2 v2fTexCoord;
+flat out uint v2fMaterial;
+
+void main()
+{
+	v2fColor = iColor;
+	v2fNormal = normalize( uNormalMatrix * iNormal );
+	v2fTexCoord = iTexCoord;
+	v2fMaterial = iMaterial;
+
+	gl_Position = uProjCameraWorld * vec4( iPosition, 1.0 );
+}
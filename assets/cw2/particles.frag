@@ -0,0 +1,15 @@
+#version 430
+
+in vec2 v2fCorner;
+in vec4 v2fColor;
+
+layout( location = 0 ) out vec4 oColor;
+
+void main()
+{
+	float falloff = 1.0 - dot( v2fCorner, v2fCorner );
+	if( falloff <= 0.0 )
+		discard;
+
+	oColor = vec4( v2fColor.rgb, v2fColor.a * falloff );
+}
@@ -0,0 +1,42 @@
+#version 430
+
+// Particles: one camera-facing quad (four-vertex triangle strip) per
+// instance, read from the particle SSBO.
+
+struct Particle
+{
+	vec4 posAge;
+	vec4 velLife;
+};
+
+layout( std430, binding = 0 ) readonly buffer Particles { Particle particles[]; };
+
+layout( location = 0 ) uniform mat4 uProjCameraWorld;
+layout( location = 1 ) uniform vec3 uRight;
+layout( location = 2 ) uniform vec3 uUp;
+layout( location = 3 ) uniform float uSize;
+
+out vec2 v2fCorner;
+out vec4 v2fColor;
+
+void main()
+{
+	Particle p = particles[gl_InstanceID];
+
+	vec2 corner = vec2( gl_VertexID & 1, gl_VertexID >> 1 ) * 2.0 - 1.0;
+
+	// Hot and small at the nozzle, then cooling and expanding into smoke.
+	float t = clamp( p.posAge.w / p.velLife.w, 0.0, 1.0 );
+	float size = uSize * mix( 0.5, 3.0, t );
+
+	vec3 hot = vec3( 1.0, 0.85, 0.45 );
+	vec3 warm = vec3( 1.0, 0.35, 0.05 );
+	vec3 smoke = vec3( 0.2 );
+	vec3 color = t < 0.25 ? mix( hot, warm, t / 0.25 ) : mix( warm, smoke, (t - 0.25) / 0.75 );
+
+	v2fCorner = corner;
+	v2fColor = vec4( color, 0.3 * (1.0 - t) );
+
+	vec3 pos = p.posAge.xyz + (corner.x * uRight + corner.y * uUp) * size;
+	gl_Position = uProjCameraWorld * vec4( pos, 1.0 );
+}
@@ -0,0 +1,33 @@
+#version 430
+
+// One GL_TEXTURE_2D and diffuse colour per draw call, for meshes drawn one
+// material at a time (see bench_materials_() in bench/main.cpp). Pairs with
+// default.vert; lighting as in default.frag.
+
+in vec3 v2fColor;
+in vec3 v2fNormal;
+in vec2 v2fTexCoord;
+flat in uint v2fMaterial;
+
+layout( location = 2 ) uniform vec3 uLightDir;
+layout( location = 3 ) uniform vec3 uLightDiffuse;
+layout( location = 4 ) uniform vec3 uSceneAmbient;
+
+layout( location = 5 ) uniform vec3 uDiffuse;   // Kd
+layout( location = 6 ) uniform bool uTextured;  // has map_Kd
+
+layout( binding = 0 ) uniform sampler2D uTexture;
+
+layout( location = 0 ) out vec4 oColor;
+
+void main()
+{
+	vec3 normal = normalize( v2fNormal );
+	float nDotL = max( 0.0, dot( normal, uLightDir ) );
+
+	vec3 albedo = uDiffuse;
+	if( uTextured )
+		albedo *= texture( uTexture, v2fTexCoord ).rgb;
+
+	oColor = vec4( (uSceneAmbient + nDotL * uLightDiffuse) * albedo, 1.0 );
+}
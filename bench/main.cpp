@@ -0,0 +1,1002 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <map>
+#include <tuple>
+#include <utility>
+#include <memory>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <vector>
+#include <numbers>
+#include <fstream>
+#include <sstream>
+#include <typeinfo>
+#include <stdexcept>
+#include <filesystem>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#	include <psapi.h>
+#else
+#	include <sys/resource.h>
+#endif
+
+#include "../../support/error.hpp"
+#include "../../support/program.hpp"
+
+#include "../../vmlib/vec3.hpp"
+#include "../../vmlib/vec4.hpp"
+#include "../../vmlib/mat44.hpp"
+#include "../../vmlib/mat33.hpp"
+
+#include "../bvh.hpp"
+#include "../defaults.hpp"
+#include "../loadObj.hpp"
+#include "../texture.hpp"
+#include "../capture.hpp"
+#include "../material.hpp"
+#include "../occlusion.hpp"
+#include "../particles.hpp"
+#include "../simple_mesh.hpp"
+
+#include "synthetic.hpp"
+
+/* Benchmarks for the loader, mesh and math hot paths.
+ *
+ * Each stage is timed on synthetic inputs of increasing size. Small inputs
+ * are repeated and the best time is reported. The primary rate of each
+ * stage/size pair is compared against the committed baseline; a drop of more
+ * than the threshold counts as a regression and makes the run fail, and so
+ * does a stage without a baseline entry (unless --allow-missing-baseline).
+ *
+ * GL-dependent stages use a hidden window. To run them on a machine without
+ * a GPU, force Mesa's software rasterizer (LIBGL_ALWAYS_SOFTWARE=1, llvmpipe).
+ */
+
+namespace
+{
+	constexpr char const* kUsage = R"(Usage: bench [options]
+  --max-tris N        largest mesh size to test (default 10000000)
+  --quick             same as --max-tris 100000 and textures up to 1024
+  --threshold F       allowed fractional slowdown vs baseline (default 0.25)
+  --baseline PATH     baseline file (default: baseline.txt next to the sources)
+  --write-baseline    record this run as the new baseline
+  --allow-missing-baseline
+                      only warn about stages without a baseline entry, rather
+                      than failing the run
+  --work-dir PATH     where synthetic inputs are cached (default: temp dir)
+  --no-gl             skip stages that require an OpenGL context
+  --terrain PATH      mesh for the BVH stages, in addition to the synthetic
+                      grids; skipped if missing (default: assets/cw2/langerso.obj)
+)";
+
+	// Exhaust-like emitter, used for timing the particles.
+	constexpr ParticleEmitter kBenchEmitter_{
+		{ 0.f, 0.f, 0.f },
+		{ 0.f, -4.f, 0.f },
+		0.35f, 0.2f, 0.1f,
+		0.5f, 2.f,
+		20000.f
+	};
+	constexpr ParticleForces kBenchForces_{ { 0.f, 1.5f, 0.f }, 0.8f };
+
+	struct Options_
+	{
+		std::size_t maxTriangles = 10'000'000;
+		int maxTextureSize = 4096;
+		double threshold = 0.25;
+		std::filesystem::path baseline = std::filesystem::path(__FILE__).parent_path() / "baseline.txt";
+		std::filesystem::path workDir = std::filesystem::temp_directory_path() / "cw2-bench";
+		bool writeBaseline = false;
+		bool allowMissingBaseline = false;
+		bool useGl = true;
+		std::filesystem::path terrain = "assets/cw2/langerso.obj";
+	};
+
+	struct Result_
+	{
+		std::string stage;
+		std::size_t size;     // problem size; triangles, texels or operations
+		double seconds;       // best time for one repetition
+		double rate;          // primary rate; compared against the baseline
+		char const* unit;     // unit of rate
+		double megabytesPerSecond;
+	};
+
+	using BaselineKey_ = std::tuple<std::string, std::size_t>;
+	using Baseline_ = std::map<BaselineKey_, double>;
+
+	Options_ parse_options_(int, char*[]);
+
+	std::size_t peak_rss_bytes_();
+
+	// Runs aFn repeatedly until at least aMinTime has passed (but at least
+	// once), and returns the best time of a single repetition in seconds.
+	template< typename tFn >
+	double time_best_(tFn&& aFn, Secondsf aMinTime = Secondsf(0.25f), int aMaxReps = 50);
+
+	Baseline_ load_baseline_(std::filesystem::path const&);
+	void write_baseline_(std::filesystem::path const&, std::vector<Result_> const&);
+
+	void bench_loader_(Options_ const&, std::vector<Result_>&, bool aWithGl);
+	void bench_textures_(Options_ const&, std::vector<Result_>&);
+	void bench_vmlib_(std::vector<Result_>&);
+	void bench_bvh_(Options_ const&, std::vector<Result_>&);
+	void bench_occlusion_(Options_ const&, std::vector<Result_>&);
+	void bench_particles_(std::vector<Result_>&);
+	void bench_materials_(Options_ const&, std::vector<Result_>&);
+	void bench_capture_(Options_ const&, std::vector<Result_>&);
+
+	void destroy_vao_(GLuint);
+
+	struct GLContext_
+	{
+		GLContext_();
+		~GLContext_();
+
+		GLContext_(GLContext_ const&) = delete;
+		GLContext_& operator=(GLContext_ const&) = delete;
+
+		GLFWwindow* window = nullptr;
+	};
+}
+
+int main(int aArgc, char* aArgv[]) try
+{
+	auto const opts = parse_options_(aArgc, aArgv);
+
+	std::filesystem::create_directories(opts.workDir);
+	std::printf("Synthetic inputs in '%s'\n", opts.workDir.string().c_str());
+
+	std::unique_ptr<GLContext_> context;
+	if (opts.useGl)
+	{
+		try
+		{
+			context = std::make_unique<GLContext_>();
+			std::printf("RENDERER %s\n", glGetString(GL_RENDERER));
+			std::printf("VERSION %s\n", glGetString(GL_VERSION));
+		}
+		catch (std::exception const& eErr)
+		{
+			std::fprintf(stderr, "No OpenGL context (%s); skipping GL stages.\n", eErr.what());
+		}
+	}
+
+	std::vector<Result_> results;
+	bench_vmlib_(results);
+	bench_loader_(opts, results, !!context);
+	bench_bvh_(opts, results);
+	bench_occlusion_(opts, results);
+	if (context)
+	{
+		bench_textures_(opts, results);
+		bench_materials_(opts, results);
+		bench_capture_(opts, results);
+		bench_particles_(results);
+	}
+
+	// Report
+	auto const baseline = load_baseline_(opts.baseline);
+
+	std::printf("\n%-20s %10s %12s %14s %10s %10s\n", "stage", "size", "time [ms]", "rate", "MB/s", "baseline");
+
+	std::size_t regressions = 0, missing = 0;
+	for (auto const& res : results)
+	{
+		char rate[32];
+		std::snprintf(rate, sizeof(rate), "%.3g %s", res.rate, res.unit);
+
+		char mbps[16] = "-";
+		if (res.megabytesPerSecond > 0.)
+			std::snprintf(mbps, sizeof(mbps), "%.1f", res.megabytesPerSecond);
+
+		char verdict[32] = "missing";
+		if (auto const it = baseline.find({ res.stage, res.size }); baseline.end() != it)
+		{
+			double const ratio = res.rate / it->second;
+			bool const regressed = ratio < 1. - opts.threshold;
+			std::snprintf(verdict, sizeof(verdict), "%+.0f%%%s", (ratio - 1.) * 100., regressed ? " FAIL" : "");
+			if (regressed)
+				++regressions;
+		}
+		else
+		{
+			++missing;
+		}
+
+		std::printf("%-20s %10zu %12.3f %14s %10s %10s\n",
+			res.stage.c_str(), res.size, res.seconds * 1000., rate, mbps, verdict
+		);
+	}
+
+	// The high-water mark of the whole run; the stages share one process,
+	// so a per-stage figure would mostly show the largest earlier stage.
+	std::printf("\nPeak RSS: %.1f MB\n", double(peak_rss_bytes_()) / (1024. * 1024.));
+
+	if (opts.writeBaseline)
+	{
+		write_baseline_(opts.baseline, results);
+		std::printf("\nWrote baseline to '%s'\n", opts.baseline.string().c_str());
+		return 0;
+	}
+
+	// Stages without a baseline entry cannot be checked for regressions, so
+	// they fail the run, unless explicitly allowed (e.g., on a machine that
+	// has no baseline of its own).
+	if (missing)
+	{
+		std::fprintf(stderr, "\n%s: %zu of %zu stage(s) have no entry in '%s' and were NOT checked for regressions.\n"
+			"Record a baseline on this machine with --write-baseline, using the same options as this run.\n",
+			opts.allowMissingBaseline ? "WARNING" : "ERROR",
+			missing, results.size(), opts.baseline.string().c_str()
+		);
+	}
+
+	if (regressions)
+		std::printf("\n%zu regression(s) beyond %.0f%% of baseline.\n", regressions, opts.threshold * 100.);
+
+	if (regressions || (missing && !opts.allowMissingBaseline))
+		return 1;
+
+	return 0;
+}
+catch (std::exception const& eErr)
+{
+	std::fprintf(stderr, "Top-level Exception (%s):\n", typeid(eErr).name());
+	std::fprintf(stderr, "%s\n", eErr.what());
+	std::fprintf(stderr, "Bye.\n");
+	return 2;
+}
+
+
+namespace
+{
+	Options_ parse_options_(int aArgc, char* aArgv[])
+	{
+		Options_ ret;
+
+		for (int i = 1; i < aArgc; ++i)
+		{
+			auto const value = [&] () -> char const* {
+				if (i + 1 >= aArgc)
+					throw Error("Option '%s' requires a value\n%s", aArgv[i], kUsage);
+				return aArgv[++i];
+			};
+
+			if (0 == std::strcmp(aArgv[i], "--max-tris"))
+				ret.maxTriangles = std::strtoull(value(), nullptr, 10);
+			else if (0 == std::strcmp(aArgv[i], "--quick"))
+			{
+				ret.maxTriangles = 100'000;
+				ret.maxTextureSize = 1024;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--threshold"))
+				ret.threshold = std::strtod(value(), nullptr);
+			else if (0 == std::strcmp(aArgv[i], "--baseline"))
+				ret.baseline = value();
+			else if (0 == std::strcmp(aArgv[i], "--write-baseline"))
+				ret.writeBaseline = true;
+			else if (0 == std::strcmp(aArgv[i], "--allow-missing-baseline"))
+				ret.allowMissingBaseline = true;
+			else if (0 == std::strcmp(aArgv[i], "--work-dir"))
+				ret.workDir = value();
+			else if (0 == std::strcmp(aArgv[i], "--no-gl"))
+				ret.useGl = false;
+			else if (0 == std::strcmp(aArgv[i], "--terrain"))
+				ret.terrain = value();
+			else
+				throw Error("Unknown option '%s'\n%s", aArgv[i], kUsage);
+		}
+
+		return ret;
+	}
+
+	std::size_t peak_rss_bytes_()
+	{
+#		if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS pmc{};
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+			return pmc.PeakWorkingSetSize;
+		return 0;
+#		else
+		rusage usage{};
+		if (0 == getrusage(RUSAGE_SELF, &usage))
+		{
+#			if defined(__APPLE__)
+			return std::size_t(usage.ru_maxrss); // bytes
+#			else
+			return std::size_t(usage.ru_maxrss) * 1024; // kilobytes
+#			endif
+		}
+		return 0;
+#		endif
+	}
+
+	template< typename tFn >
+	double time_best_(tFn&& aFn, Secondsf aMinTime, int aMaxReps)
+	{
+		double best = std::numeric_limits<double>::max();
+
+		auto const start = Clock::now();
+		for (int i = 0; i < aMaxReps; ++i)
+		{
+			auto const before = Clock::now();
+			aFn();
+			auto const after = Clock::now();
+
+			best = std::min(best, double(Secondsf(after - before).count()));
+			if (after - start >= aMinTime)
+				break;
+		}
+
+		return best;
+	}
+
+	Baseline_ load_baseline_(std::filesystem::path const& aPath)
+	{
+		Baseline_ ret;
+
+		std::ifstream ifs(aPath);
+		std::string line;
+		while (std::getline(ifs, line))
+		{
+			if (line.empty() || '#' == line[0])
+				continue;
+
+			std::istringstream iss(line);
+			std::string stage;
+			std::size_t size;
+			double rate;
+			if (!(iss >> stage >> size >> rate))
+				throw Error("Malformed baseline line in '%s': %s", aPath.string().c_str(), line.c_str());
+
+			ret[{ stage, size }] = rate;
+		}
+
+		return ret;
+	}
+
+	void write_baseline_(std::filesystem::path const& aPath, std::vector<Result_> const& aResults)
+	{
+		std::ofstream ofs(aPath);
+		if (!ofs)
+			throw Error("Unable to write baseline '%s'", aPath.string().c_str());
+
+		ofs << "# stage size rate\n";
+		ofs << "# Rates are per second; see bench/main.cpp for the unit of each stage.\n";
+		ofs << "#\n";
+		ofs << "# Baselines are machine specific, and only cover the sizes of the run that\n";
+		ofs << "# recorded them. Stages without an entry fail the run, unless\n";
+		ofs << "# --allow-missing-baseline is given.\n";
+		for (auto const& res : aResults)
+			ofs << res.stage << ' ' << res.size << ' ' << res.rate << '\n';
+	}
+
+	void bench_loader_(Options_ const& aOpts, std::vector<Result_>& aResults, bool aWithGl)
+	{
+		for (std::size_t tris = 1000; tris <= aOpts.maxTriangles; tris *= 10)
+		{
+			auto const obj = make_grid_obj(aOpts.workDir, tris);
+			double const mb = double(obj.bytes) / (1024. * 1024.);
+
+			// Large inputs take seconds per repetition; one is enough there.
+			auto const minTime = tris >= 1'000'000 ? Secondsf(0.f) : Secondsf(0.25f);
+
+			SimpleMeshData mesh;
+			double t = time_best_([&] {
+				mesh = load_wavefront_obj(obj.path.string().c_str());
+			}, minTime);
+			aResults.push_back({ "load_wavefront_obj", tris, t, double(obj.triangles) / t, "tri/s", mb / t });
+
+			// Vertex payload, as uploaded by create_vao().
+			double const meshMb = double(mesh.positions.size() * (3 * sizeof(Vec3f) + sizeof(Vec2f) + sizeof(std::uint32_t))) / (1024. * 1024.);
+
+			t = time_best_([&] {
+				auto const both = concatenate(mesh, mesh);
+				if (both.positions.size() != 2 * mesh.positions.size())
+					throw Error("concatenate(): unexpected result size");
+			}, minTime);
+			aResults.push_back({ "concatenate", tris, t, 2. * double(obj.triangles) / t, "tri/s", 2. * meshMb / t });
+
+			if (aWithGl)
+			{
+				// glFinish() ensures that the upload is included in the
+				// measurement, rather than deferred by the driver.
+				t = time_best_([&] {
+					GLuint const vao = create_vao(mesh);
+					glFinish();
+					destroy_vao_(vao);
+				}, minTime);
+				aResults.push_back({ "create_vao", tris, t, double(obj.triangles) / t, "tri/s", meshMb / t });
+			}
+		}
+	}
+
+	void bench_textures_(Options_ const& aOpts, std::vector<Result_>& aResults)
+	{
+		for (int size = 256; size <= aOpts.maxTextureSize; size *= 2)
+		{
+			auto const tex = make_noise_texture(aOpts.workDir, size);
+			double const mb = double(tex.decodedBytes) / (1024. * 1024.);
+
+			double const t = time_best_([&] {
+				GLuint const id = load_texture_2d(tex.path.string().c_str());
+				glFinish();
+				glDeleteTextures(1, &id);
+			});
+
+			auto const texels = std::size_t(size) * std::size_t(size);
+			aResults.push_back({ "load_texture_2d", texels, t, double(texels) / t, "texel/s", mb / t });
+		}
+	}
+
+	void bench_vmlib_(std::vector<Result_>& aResults)
+	{
+		constexpr std::size_t kCount = 1024;
+
+		// Well-conditioned inputs, so that invert() does not end up working
+		// on denormals or infinities.
+		std::vector<Mat44f> mats(kCount);
+		std::vector<Vec4f> vecs(kCount);
+		for (std::size_t i = 0; i < kCount; ++i)
+		{
+			float const f = float(i) / kCount;
+			mats[i] = make_translation({ f, 2.f * f, -f })
+				* make_rotation_y(f * std::numbers::pi_v<float>)
+				* make_rotation_x(0.5f * f);
+			vecs[i] = { f, 1.f - f, 0.5f, 1.f };
+		}
+
+		std::vector<Mat44f> outM(kCount);
+		std::vector<Vec4f> outV(kCount);
+
+		auto const record = [&] (char const* aStage, double aSeconds) {
+			aResults.push_back({ aStage, kCount, aSeconds, double(kCount) / aSeconds, "op/s", 0. });
+		};
+
+		record("mat44_mul", time_best_([&] {
+			for (std::size_t i = 0; i < kCount; ++i)
+				outM[i] = mats[i] * mats[(i + 1) % kCount];
+		}, Secondsf(0.25f), 1000));
+
+		record("mat44_mul_vec4", time_best_([&] {
+			for (std::size_t i = 0; i < kCount; ++i)
+				outV[i] = mats[i] * vecs[i];
+		}, Secondsf(0.25f), 1000));
+
+		record("mat44_invert", time_best_([&] {
+			for (std::size_t i = 0; i < kCount; ++i)
+				outM[i] = invert(mats[i]);
+		}, Secondsf(0.25f), 1000));
+
+		record("mat44_transpose", time_best_([&] {
+			for (std::size_t i = 0; i < kCount; ++i)
+				outM[i] = transpose(mats[i]);
+		}, Secondsf(0.25f), 1000));
+
+		record("mat44_perspective", time_best_([&] {
+			for (std::size_t i = 0; i < kCount; ++i)
+				outM[i] = make_perspective_projection(0.5f + vecs[i].x, 1.7f, 0.1f, 100.f);
+		}, Secondsf(0.25f), 1000));
+
+		// Keep the results observable, so the loops are not optimized away.
+		float sink = 0.f;
+		for (std::size_t i = 0; i < kCount; ++i)
+			sink += outM[i].v[i % 16] + outV[i].x;
+		if (sink != sink)
+			std::printf("(NaN in vmlib results)\n");
+	}
+
+	// Primary rays of a 256x256 view from above and to the side of the mesh,
+	// looking at its centre. Packets are 2x2 pixel blocks, as a renderer or a
+	// picking query over an area would use them.
+	struct RayPacket_
+	{
+		Ray rays[4];
+	};
+	struct HitPacket_
+	{
+		RayHit hits[4];
+	};
+
+	std::vector<RayPacket_> make_view_packets_(SimpleMeshData const& aMesh)
+	{
+		constexpr int kSize = 256;
+
+		Vec3f lo{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		Vec3f hi = -lo;
+		for (auto const& p : aMesh.positions)
+		{
+			lo = { std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+			hi = { std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+		}
+
+		auto const centre = (lo + hi) * 0.5f;
+		float const extent = length(hi - lo);
+
+		auto const eye = centre + Vec3f{ 0.f, 0.3f * extent, -0.6f * extent };
+		auto const forward = normalize(centre - eye);
+		auto const right = normalize(cross(forward, Vec3f{ 0.f, 1.f, 0.f }));
+		auto const up = cross(right, forward);
+
+		float const halfFov = std::tan(30.f * std::numbers::pi_v<float> / 180.f);
+
+		std::vector<RayPacket_> ret;
+		ret.reserve(kSize * kSize / 4);
+		for (int y = 0; y < kSize; y += 2)
+		{
+			for (int x = 0; x < kSize; x += 2)
+			{
+				RayPacket_ packet;
+				for (int i = 0; i < 4; ++i)
+				{
+					float const sx = (2.f * (float(x + i % 2) + 0.5f) / kSize - 1.f) * halfFov;
+					float const sy = (1.f - 2.f * (float(y + i / 2) + 0.5f) / kSize) * halfFov;
+					packet.rays[i] = Ray{ eye, forward + right * sx + up * sy };
+				}
+				ret.emplace_back(packet);
+			}
+		}
+
+		return ret;
+	}
+
+	void bench_bvh_mesh_(char const* aPrefix, SimpleMeshData const& aMesh, std::vector<Result_>& aResults)
+	{
+		auto const tris = aMesh.positions.size() / 3;
+		auto const minTime = tris >= 1'000'000 ? Secondsf(0.f) : Secondsf(0.25f);
+		auto const stage = [aPrefix] (char const* aName) { return std::string(aPrefix) + aName; };
+
+		TriangleBvh bvh;
+		double t = time_best_([&] {
+			bvh = TriangleBvh(aMesh);
+		}, minTime);
+		aResults.push_back({ stage("bvh_build"), tris, t, double(tris) / t, "tri/s", 0. });
+
+		auto const packets = make_view_packets_(aMesh);
+		auto const rayCount = double(packets.size() * 4);
+
+		std::vector<RayHit> single(packets.size() * 4);
+		t = time_best_([&] {
+			for (std::size_t i = 0; i < packets.size(); ++i)
+			{
+				for (int j = 0; j < 4; ++j)
+					single[i * 4 + std::size_t(j)] = bvh.intersect(packets[i].rays[j]);
+			}
+		});
+		aResults.push_back({ stage("bvh_ray"), tris, t, rayCount / t, "ray/s", 0. });
+
+		std::vector<HitPacket_> packet(packets.size());
+		t = time_best_([&] {
+			for (std::size_t i = 0; i < packets.size(); ++i)
+				bvh.intersect4(packets[i].rays, packet[i].hits);
+		});
+		aResults.push_back({ stage("bvh_ray4"), tris, t, rayCount / t, "ray/s", 0. });
+
+		// Correctness is checked by the tests (test/bvh-queries.cpp).
+		std::size_t hits = 0;
+		for (auto const& hit : single)
+			hits += bool(hit);
+
+		std::printf("BVH (%zu triangles): %zu nodes, depth %zu; %zu of %zu rays hit\n",
+			tris, bvh.node_count(), bvh.depth(), hits, single.size()
+		);
+	}
+
+	void bench_bvh_(Options_ const& aOpts, std::vector<Result_>& aResults)
+	{
+		for (std::size_t tris = 10'000; tris <= aOpts.maxTriangles; tris *= 10)
+		{
+			auto const obj = make_grid_obj(aOpts.workDir, tris);
+			bench_bvh_mesh_("", load_wavefront_obj(obj.path.string().c_str()), aResults);
+		}
+
+		if (!std::filesystem::exists(aOpts.terrain))
+		{
+			std::printf("BVH: terrain '%s' not found; skipping.\n", aOpts.terrain.string().c_str());
+			return;
+		}
+
+		bench_bvh_mesh_("terrain_", load_wavefront_obj(aOpts.terrain.string().c_str()), aResults);
+	}
+
+	// Rolling hills with a ridge across the middle; unlike the synthetic
+	// grids, this hides a good part of itself from a viewer near the ground.
+	SimpleMeshData make_hills_(std::size_t aSize)
+	{
+		auto const height = [] (std::size_t aX, std::size_t aZ) {
+			float const x = float(aX), z = float(aZ);
+			float const ridge = 12.f * std::exp(-0.02f * (z - 128.f) * (z - 128.f));
+			return 6.f * std::sin(0.05f * x) * std::cos(0.07f * z) + ridge;
+		};
+
+		SimpleMeshData ret;
+		ret.positions.reserve(aSize * aSize * 6);
+		for (std::size_t z = 0; z < aSize; ++z)
+		{
+			for (std::size_t x = 0; x < aSize; ++x)
+			{
+				Vec3f const p00{ float(x), height(x, z), float(z) };
+				Vec3f const p10{ float(x + 1), height(x + 1, z), float(z) };
+				Vec3f const p01{ float(x), height(x, z + 1), float(z + 1) };
+				Vec3f const p11{ float(x + 1), height(x + 1, z + 1), float(z + 1) };
+				ret.positions.insert(ret.positions.end(), { p00, p01, p10, p10, p01, p11 });
+			}
+		}
+
+		return ret;
+	}
+
+	void bench_occlusion_mesh_(char const* aPrefix, SimpleMeshData aMesh, std::vector<Result_>& aResults)
+	{
+		constexpr int kViews = 64;
+		auto const stage = [aPrefix] (char const* aName) { return std::string(aPrefix) + aName; };
+
+		auto const chunks = make_draw_chunks(aMesh, 16);
+		auto const occluder = make_heightfield_occluder(aMesh, 64);
+		TriangleBvh const bvh(aMesh);
+
+		// Views from just above the ground, on a ring around the centre,
+		// looking in all directions.
+		Vec3f lo{ std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+		Vec3f hi = -lo;
+		for (auto const& p : aMesh.positions)
+		{
+			lo = { std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+			hi = { std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+		}
+
+		auto const centre = (lo + hi) * 0.5f;
+		float const radius = 0.3f * std::min(hi.x - lo.x, hi.z - lo.z);
+		float const eyeHeight = 0.01f * length(hi - lo);
+
+		auto const projection = make_perspective_projection(60.f * std::numbers::pi_v<float> / 180.f, 16.f / 9.f, 0.1f, 1000.f);
+
+		std::vector<Mat44f> views;
+		for (int i = 0; i < kViews; ++i)
+		{
+			float const angle = 2.f * std::numbers::pi_v<float> * float(i) / kViews;
+			Vec3f eye{ centre.x + radius * std::cos(angle), hi.y + 1.f, centre.z + radius * std::sin(angle) };
+			if (auto const hit = bvh.intersect(Ray{ eye, { 0.f, -1.f, 0.f } }))
+				eye.y -= hit.t;
+			eye.y += eyeHeight;
+
+			float const yaw = 2.39996f * float(i); // golden angle
+			views.emplace_back(projection * make_rotation_x(0.1f) * make_rotation_y(yaw) * make_translation(-eye));
+		}
+
+		std::vector<GLint> firsts;
+		std::vector<GLsizei> counts;
+
+		for (bool const avx2 : { true, false })
+		{
+			OcclusionCuller culler(occluder, { 320, 180, 0, avx2 });
+			if (avx2 && !culler.uses_avx2())
+			{
+				std::printf("Occlusion: CPU does not support AVX2; skipping %s.\n", stage("occlusion_avx2").c_str());
+				continue;
+			}
+
+			double const t = time_best_([&] {
+				for (auto const& view : views)
+				{
+					culler.begin(view);
+					culler.cull(chunks, firsts, counts);
+				}
+			});
+			aResults.push_back({ stage(avx2 ? "occlusion_avx2" : "occlusion_scalar"), occluder.size() / 3, t, kViews / t, "frame/s", 0. });
+
+			// That both rasterizers agree is checked by the tests
+			// (test/occlusion-culling.cpp).
+			culler.report();
+			for (auto const& view : views)
+			{
+				culler.begin(view);
+				culler.cull(chunks, firsts, counts);
+			}
+
+			auto const stats = culler.report();
+			std::printf("Occlusion (%s, %zu occluder triangles, %zu workers): %.1f of %zu chunks occluded, %.1f outside per view; %.0f%% of triangles culled\n",
+				avx2 ? "AVX2" : "scalar", occluder.size() / 3, culler.worker_count(),
+				double(stats.occluded) / kViews, chunks.size(), double(stats.outside) / kViews,
+				100. * double(stats.occludedTriangles) / double(std::max<std::size_t>(stats.triangles, 1))
+			);
+		}
+	}
+
+	void bench_occlusion_(Options_ const& aOpts, std::vector<Result_>& aResults)
+	{
+		bench_occlusion_mesh_("", make_hills_(256), aResults);
+
+		if (!std::filesystem::exists(aOpts.terrain))
+		{
+			std::printf("Occlusion: terrain '%s' not found; skipping.\n", aOpts.terrain.string().c_str());
+			return;
+		}
+
+		bench_occlusion_mesh_("terrain_", load_wavefront_obj(aOpts.terrain.string().c_str()), aResults);
+	}
+
+	void bench_materials_(Options_ const& aOpts, std::vector<Result_>& aResults)
+	{
+		constexpr std::size_t kTriangles = 100'000;
+		constexpr std::size_t kMaterials = 16;
+		constexpr GLsizei kSize = 512;
+
+		auto const obj = make_material_grid_obj(aOpts.workDir, kTriangles, kMaterials);
+		auto const mesh = load_wavefront_obj(obj.path.string().c_str());
+
+		MaterialSet set;
+		double t = time_best_([&] {
+			if (set.layerTable)
+				delete_material_set(set);
+			set = create_material_set(mesh.materials);
+			glFinish();
+		});
+		aResults.push_back({ "create_material_set", set.layerCount, t, double(set.layerCount) / t, "layer/s", 0. });
+
+		// Faces are grouped by material, so the per-material path can draw
+		// each material's run of vertices with its own call.
+		std::vector<std::pair<GLint, GLsizei>> runs;
+		for (std::size_t i = 0; i < mesh.materialIds.size(); ++i)
+		{
+			if (0 == i || mesh.materialIds[i] != mesh.materialIds[i - 1])
+				runs.emplace_back(GLint(i), 0);
+			++runs.back().second;
+		}
+
+		// The per-material baseline: one GL_TEXTURE_2D per material, as a
+		// renderer without the texture array would have.
+		std::vector<GLuint> perMaterialTextures;
+		for (auto const& mat : mesh.materials)
+			perMaterialTextures.emplace_back(mat.diffuseTexture.empty() ? 0 : load_texture_2d(mat.diffuseTexture.c_str()));
+
+		GLuint const vao = create_vao(mesh);
+
+		ShaderProgram const prog({
+			{ GL_VERTEX_SHADER, "assets/cw2/default.vert" },
+			{ GL_FRAGMENT_SHADER, "assets/cw2/default.frag" }
+		});
+		ShaderProgram const perMaterialProg({
+			{ GL_VERTEX_SHADER, "assets/cw2/default.vert" },
+			{ GL_FRAGMENT_SHADER, "assets/cw2/per-material.frag" }
+		});
+
+		GLuint fbo = 0, rbos[2] = {};
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glGenRenderbuffers(2, rbos);
+		glBindRenderbuffer(GL_RENDERBUFFER, rbos[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, kSize, kSize);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbos[0]);
+		glBindRenderbuffer(GL_RENDERBUFFER, rbos[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, kSize, kSize);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbos[1]);
+
+		glViewport(0, 0, kSize, kSize);
+		glEnable(GL_DEPTH_TEST);
+
+		// Look down onto the grid (which spans 0..100 in x and z).
+		auto const proj = make_perspective_projection(1.f, 1.f, 0.1f, 500.f)
+			* make_rotation_x(0.5f * std::numbers::pi_v<float>)
+			* make_translation({ -50.f, -120.f, -50.f });
+		auto const normal = mat44_to_mat33(kIdentity44f);
+
+		for (auto const* program : { &prog, &perMaterialProg })
+		{
+			glUseProgram(program->programId());
+			glUniformMatrix4fv(0, 1, GL_TRUE, proj.v);
+			glUniformMatrix3fv(1, 1, GL_TRUE, normal.v);
+			glUniform3f(2, 0.f, 1.f, 0.f);
+			glUniform3f(3, 1.f, 1.f, 1.f);
+			glUniform3f(4, 0.2f, 0.2f, 0.2f);
+		}
+		glBindVertexArray(vao);
+
+		auto const frames = [] (double aSeconds) { return 1. / aSeconds; };
+
+		// Per material: bind its texture, set its diffuse colour, draw.
+		glUseProgram(perMaterialProg.programId());
+		glActiveTexture(GL_TEXTURE0 + kMaterialTextureUnit);
+		t = time_best_([&] {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			for (auto const& run : runs)
+			{
+				auto const id = mesh.materialIds[std::size_t(run.first)];
+				auto const& kd = mesh.materials[id].diffuse;
+				glBindTexture(GL_TEXTURE_2D, perMaterialTextures[id]);
+				glUniform3f(5, kd.x, kd.y, kd.z);
+				glUniform1i(6, 0 != perMaterialTextures[id]);
+				glDrawArrays(GL_TRIANGLES, run.first, run.second);
+			}
+			glFinish();
+		});
+		glBindTexture(GL_TEXTURE_2D, 0);
+		aResults.push_back({ "draw_per_material", kTriangles, t, frames(t), "frame/s", 0. });
+
+		glUseProgram(prog.programId());
+		t = time_best_([&] {
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			bind_material_set(set);
+			glDrawArrays(GL_TRIANGLES, 0, GLsizei(mesh.positions.size()));
+			glFinish();
+		});
+		aResults.push_back({ "draw_single_call", kTriangles, t, frames(t), "frame/s", 0. });
+
+		auto const stats = per_material_draw_stats(mesh);
+		std::printf("Materials: %zu materials, %zu texture layers; draw calls %zu -> 1, texture binds %zu -> 1\n",
+			set.materialCount, set.layerCount, stats.draws, stats.textureBinds);
+
+		glBindVertexArray(0);
+		glUseProgram(0);
+		glDisable(GL_DEPTH_TEST);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteRenderbuffers(2, rbos);
+		glDeleteFramebuffers(1, &fbo);
+		destroy_vao_(vao);
+		glDeleteTextures(GLsizei(perMaterialTextures.size()), perMaterialTextures.data());
+		delete_material_set(set);
+	}
+
+	void bench_capture_(Options_ const& aOpts, std::vector<Result_>& aResults)
+	{
+		constexpr GLsizei kWidth = 1280, kHeight = 720;
+		constexpr int kFrames = 120;
+
+		GLuint fbo = 0, rbo = 0;
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glGenRenderbuffers(1, &rbo);
+		glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, kWidth, kHeight);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
+		glViewport(0, 0, kWidth, kHeight);
+
+		auto const frame = [] (int aIndex) {
+			glClearColor(float(aIndex % 60) / 60.f, 0.5f, 0.25f, 1.f);
+			glClear(GL_COLOR_BUFFER_BIT);
+		};
+
+		auto const dir = aOpts.workDir / "capture";
+		std::filesystem::create_directories(dir);
+
+		double const mbPerFrame = double(kWidth) * kHeight * 4 / (1024. * 1024.);
+
+		// Naive: glReadPixels() into client memory waits for the frame.
+		std::vector<unsigned char> pixels(std::size_t(kWidth) * kHeight * 4);
+		auto start = Clock::now();
+		for (int i = 0; i < kFrames; ++i)
+		{
+			frame(i);
+			glReadPixels(0, 0, kWidth, kHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+		}
+		double t = Secondsf(Clock::now() - start).count() / kFrames;
+		aResults.push_back({ "capture_sync", std::size_t(kWidth) * kHeight, t, 1. / t, "frame/s", mbPerFrame / t });
+
+		// Asynchronous: the cost seen by the render loop, plus writing the
+		// frames out (raw) on the worker threads.
+		{
+			FrameCapture capture;
+			start = Clock::now();
+			for (int i = 0; i < kFrames; ++i)
+			{
+				frame(i);
+
+				char name[32];
+				std::snprintf(name, sizeof(name), "frame-%04d.ppm", i);
+				capture.capture(kWidth, kHeight, (dir / name).string(), CaptureFormat::raw);
+				capture.poll();
+			}
+			t = Secondsf(Clock::now() - start).count() / kFrames;
+			capture.flush();
+
+			auto const stats = capture.stats();
+			std::printf("Capture: %zu of %zu frames written, %zu dropped\n", stats.written, stats.requested, stats.dropped);
+		}
+		aResults.push_back({ "capture_async", std::size_t(kWidth) * kHeight, t, 1. / t, "frame/s", mbPerFrame / t });
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glDeleteRenderbuffers(1, &rbo);
+		glDeleteFramebuffers(1, &fbo);
+	}
+
+	void bench_particles_(std::vector<Result_>& aResults)
+	{
+		// Throughput with a full buffer of a million particles. That the
+		// GPU simulation agrees with the CPU reference is checked by the
+		// tests (test/particles-simulation.cpp).
+		constexpr float kDt = 1.f / 60.f;
+		constexpr std::size_t kCapacity = 1 << 20;
+
+		auto emitter = kBenchEmitter_;
+		emitter.lifeMin = emitter.lifeMax = 4.f;
+		emitter.rate = float(kCapacity) / emitter.lifeMax;
+
+		ParticleSystem gpu(kCapacity);
+		for (int i = 0; i < 300; ++i)
+			gpu.update(kDt, { &emitter, 1 }, kBenchForces_);
+		glFinish();
+
+		double const t = time_best_([&] {
+			gpu.update(kDt, { &emitter, 1 }, kBenchForces_);
+			glFinish();
+		});
+
+		double const mb = double(kCapacity * sizeof(Particle) * 2) / (1024. * 1024.);
+		aResults.push_back({ "particles_update", kCapacity, t, double(kCapacity) / t, "particle/s", mb / t });
+	}
+
+	void destroy_vao_(GLuint aVao)
+	{
+		// create_vao() only returns the VAO; recover the buffers from the
+		// attribute bindings so that they can be released as well.
+		glBindVertexArray(aVao);
+
+		GLint maxAttribs = 0;
+		glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &maxAttribs);
+
+		std::vector<GLuint> buffers;
+		for (GLint i = 0; i < maxAttribs; ++i)
+		{
+			GLint buffer = 0;
+			glGetVertexAttribiv(GLuint(i), GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffer);
+			if (buffer && buffers.end() == std::find(buffers.begin(), buffers.end(), GLuint(buffer)))
+				buffers.emplace_back(GLuint(buffer));
+		}
+
+		glBindVertexArray(0);
+		glDeleteVertexArrays(1, &aVao);
+		glDeleteBuffers(GLsizei(buffers.size()), buffers.data());
+	}
+
+	GLContext_::GLContext_()
+	{
+		if (GLFW_TRUE != glfwInit())
+		{
+			char const* msg = nullptr;
+			int ecode = glfwGetError(&msg);
+			throw Error("glfwInit() failed with '%s' (%d)", msg, ecode);
+		}
+
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		window = glfwCreateWindow(64, 64, "bench", nullptr, nullptr);
+		if (!window)
+		{
+			char const* msg = nullptr;
+			int ecode = glfwGetError(&msg);
+			glfwTerminate();
+			throw Error("glfwCreateWindow() failed with '%s' (%d)", msg, ecode);
+		}
+
+		glfwMakeContextCurrent(window);
+		glfwSwapInterval(0);
+
+		if (!gladLoadGLLoader((GLADloadproc)&glfwGetProcAddress))
+		{
+			glfwDestroyWindow(window);
+			glfwTerminate();
+			throw Error("gladLoaDGLLoader() failed - cannot load GL API!");
+		}
+	}
+
+	GLContext_::~GLContext_()
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+}
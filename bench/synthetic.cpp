@@ -0,0 +1,202 @@
+#include "synthetic.hpp"
+
+#include <memory>
+#include <vector>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+
+#include "stb_image_write.h"
+
+#include "../../support/error.hpp"
+
+namespace
+{
+	struct FileCloser_
+	{
+		void operator()(std::FILE* aFile) const noexcept { std::fclose(aFile); }
+	};
+
+	std::uint32_t hash_(std::uint32_t aX) noexcept
+	{
+		aX ^= aX >> 16; aX *= 0x7feb352du;
+		aX ^= aX >> 15; aX *= 0x846ca68bu;
+		aX ^= aX >> 16;
+		return aX;
+	}
+
+	SyntheticObj write_grid_obj_(std::filesystem::path const& aDir, std::size_t aTriangles, std::size_t aMaterials)
+	{
+		auto const quads = (aTriangles + 1) / 2;
+		auto const nx = std::size_t(std::ceil(std::sqrt(double(quads))));
+		auto const nz = (quads + nx - 1) / nx;
+
+		SyntheticObj ret;
+		ret.triangles = 2 * nx * nz;
+
+		char name[64];
+		if (aMaterials)
+			std::snprintf(name, sizeof(name), "grid-%zux%zu-m%zu.obj", nx, nz, aMaterials);
+		else
+			std::snprintf(name, sizeof(name), "grid-%zux%zu.obj", nx, nz);
+		ret.path = aDir / name;
+
+		std::error_code ec;
+		if (std::filesystem::exists(ret.path, ec))
+		{
+			ret.bytes = std::filesystem::file_size(ret.path);
+			return ret;
+		}
+
+		// Materials, each with its own texture.
+		auto const mtlName = std::filesystem::path(ret.path).replace_extension(".mtl").filename();
+		if (aMaterials)
+		{
+			std::unique_ptr<std::FILE, FileCloser_> mtl(std::fopen((aDir / mtlName).string().c_str(), "wb"));
+			if (!mtl)
+				throw Error("Unable to create '%s'", (aDir / mtlName).string().c_str());
+
+			for (std::size_t m = 0; m < aMaterials; ++m)
+			{
+				auto const tex = make_noise_texture(aDir, (m % 2) ? 512 : 256);
+				std::fprintf(mtl.get(), "newmtl mat%zu\nKd %.3f %.3f %.3f\nmap_Kd %s\n\n",
+					m, 0.5f + 0.5f * float(m % 3) / 2.f, 0.8f, 0.5f + 0.5f * float(m % 5) / 4.f,
+					tex.path.filename().string().c_str()
+				);
+			}
+		}
+
+		// Write to a temporary name first, so that an interrupted run does not
+		// leave a truncated file behind that later runs would pick up.
+		auto const tmp = std::filesystem::path(ret.path).concat(".tmp");
+		std::unique_ptr<std::FILE, FileCloser_> file(std::fopen(tmp.string().c_str(), "wb"));
+		if (!file)
+			throw Error("Unable to create '%s'", tmp.string().c_str());
+
+		std::vector<char> buffer(std::size_t(1) << 20);
+		std::setvbuf(file.get(), buffer.data(), _IOFBF, buffer.size());
+
+		std::fprintf(file.get(), "# synthetic %zu x %zu grid, %zu triangles\n", nx, nz, ret.triangles);
+		if (aMaterials)
+			std::fprintf(file.get(), "mtllib %s\n", mtlName.string().c_str());
+
+		float const scale = 100.f / float(nx > nz ? nx : nz);
+		for (std::size_t z = 0; z <= nz; ++z)
+		{
+			for (std::size_t x = 0; x <= nx; ++x)
+			{
+				// Some height variation, so that the data is not trivially
+				// compressible and the normals are not all identical.
+				float const h = 0.25f * std::sin(0.37f * float(x)) * std::cos(0.23f * float(z));
+				std::fprintf(file.get(), "v %.6f %.6f %.6f\n", float(x) * scale, h, float(z) * scale);
+			}
+		}
+		for (std::size_t z = 0; z <= nz; ++z)
+		{
+			for (std::size_t x = 0; x <= nx; ++x)
+				std::fprintf(file.get(), "vt %.6f %.6f\n", float(x) / float(nx), float(z) / float(nz));
+		}
+		for (std::size_t z = 0; z <= nz; ++z)
+		{
+			for (std::size_t x = 0; x <= nx; ++x)
+			{
+				float const a = 0.1f * std::sin(0.37f * float(x));
+				float const b = 0.1f * std::cos(0.23f * float(z));
+				float const l = std::sqrt(a * a + b * b + 1.f);
+				std::fprintf(file.get(), "vn %.6f %.6f %.6f\n", a / l, 1.f / l, b / l);
+			}
+		}
+
+		auto const row = nx + 1;
+		std::size_t material = ~std::size_t(0);
+		for (std::size_t z = 0; z < nz; ++z)
+		{
+			// Materials are assigned in bands of rows.
+			if (aMaterials && material != z * aMaterials / nz)
+			{
+				material = z * aMaterials / nz;
+				std::fprintf(file.get(), "usemtl mat%zu\n", material);
+			}
+
+			for (std::size_t x = 0; x < nx; ++x)
+			{
+				// OBJ indices are one-based.
+				auto const i0 = z * row + x + 1;
+				auto const i1 = i0 + 1;
+				auto const i2 = i0 + row;
+				auto const i3 = i2 + 1;
+				std::fprintf(file.get(), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", i0, i0, i0, i2, i2, i2, i1, i1, i1);
+				std::fprintf(file.get(), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", i1, i1, i1, i2, i2, i2, i3, i3, i3);
+			}
+		}
+
+		if (std::ferror(file.get()))
+			throw Error("Error while writing '%s'", tmp.string().c_str());
+
+		file.reset();
+		std::filesystem::rename(tmp, ret.path);
+
+		ret.bytes = std::filesystem::file_size(ret.path);
+		return ret;
+	}
+}
+
+SyntheticObj make_grid_obj(std::filesystem::path const& aDir, std::size_t aTriangles)
+{
+	return write_grid_obj_(aDir, aTriangles, 0);
+}
+
+SyntheticObj make_material_grid_obj(std::filesystem::path const& aDir, std::size_t aTriangles, std::size_t aMaterials)
+{
+	if (0 == aMaterials)
+		throw Error("make_material_grid_obj(): need at least one material");
+
+	return write_grid_obj_(aDir, aTriangles, aMaterials);
+}
+
+SyntheticTexture make_noise_texture(std::filesystem::path const& aDir, int aSize)
+{
+	SyntheticTexture ret;
+	ret.size = aSize;
+	ret.decodedBytes = std::uintmax_t(aSize) * std::uintmax_t(aSize) * 4;
+
+	char name[64];
+	std::snprintf(name, sizeof(name), "noise-%d.jpg", aSize);
+	ret.path = aDir / name;
+
+	std::error_code ec;
+	if (std::filesystem::exists(ret.path, ec))
+		return ret;
+
+	// Value noise: random values on a coarse lattice, bilinearly interpolated,
+	// plus a bit of per-pixel grain.
+	constexpr int kCell = 16;
+	auto const lattice = [] (int aX, int aY, int aC) {
+		return float(hash_(std::uint32_t(aX * 73856093) ^ std::uint32_t(aY * 19349663) ^ std::uint32_t(aC)) & 0xff);
+	};
+
+	std::vector<unsigned char> pixels(std::size_t(aSize) * std::size_t(aSize) * 3);
+	for (int y = 0; y < aSize; ++y)
+	{
+		for (int x = 0; x < aSize; ++x)
+		{
+			int const cx = x / kCell, cy = y / kCell;
+			float const fx = float(x % kCell) / kCell, fy = float(y % kCell) / kCell;
+			for (int c = 0; c < 3; ++c)
+			{
+				float const top = lattice(cx, cy, c) * (1.f - fx) + lattice(cx + 1, cy, c) * fx;
+				float const bot = lattice(cx, cy + 1, c) * (1.f - fx) + lattice(cx + 1, cy + 1, c) * fx;
+				float const grain = float(hash_(std::uint32_t(y * aSize + x) * 3u + std::uint32_t(c)) & 0x1f) - 16.f;
+				float const value = top * (1.f - fy) + bot * fy + grain;
+				pixels[(std::size_t(y) * std::size_t(aSize) + std::size_t(x)) * 3 + std::size_t(c)]
+					= (unsigned char)(value < 0.f ? 0.f : (value > 255.f ? 255.f : value));
+			}
+		}
+	}
+
+	if (!stbi_write_jpg(ret.path.string().c_str(), aSize, aSize, 3, pixels.data(), 90))
+		throw Error("Unable to write '%s'", ret.path.string().c_str());
+
+	return ret;
+}
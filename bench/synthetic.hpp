@@ -0,0 +1,41 @@
+#ifndef SYNTHETIC_HPP_A0EA6635_2E2C_4EA4_82D8_DE4FC3B0CC1E
+#define SYNTHETIC_HPP_A0EA6635_2E2C_4EA4_82D8_DE4FC3B0CC1E
+
+#include <filesystem>
+
+#include <cstddef>
+#include <cstdint>
+
+/* Synthetic inputs for the benchmarks.
+ *
+ * The generated files are cached in aDir and reused by later runs, since
+ * writing the larger OBJ files takes considerably longer than loading them.
+ */
+
+struct SyntheticObj
+{
+	std::filesystem::path path;
+	std::size_t triangles;
+	std::uintmax_t bytes;
+};
+
+// Regular grid of quads (two triangles each) with positions, normals and
+// texture coordinates. The triangle count is rounded up to fill the grid.
+SyntheticObj make_grid_obj(std::filesystem::path const& aDir, std::size_t aTriangles);
+
+// Same grid, split into aMaterials bands of faces with one material each.
+// Every material references its own noise texture; sizes alternate between
+// 256 and 512 pixels, so that building a texture array has to resample.
+SyntheticObj make_material_grid_obj(std::filesystem::path const& aDir, std::size_t aTriangles, std::size_t aMaterials);
+
+struct SyntheticTexture
+{
+	std::filesystem::path path;
+	int size;
+	std::uintmax_t decodedBytes;
+};
+
+// Square JPEG with value noise, similar in character to the terrain texture.
+SyntheticTexture make_noise_texture(std::filesystem::path const& aDir, int aSize);
+
+#endif // SYNTHETIC_HPP_A0EA6635_2E2C_4EA4_82D8_DE4FC3B0CC1E
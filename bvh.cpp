@@ -0,0 +1,714 @@
+#include "bvh.hpp"
+
+#include <atomic>
+#include <memory>
+#include <future>
+#include <thread>
+#include <algorithm>
+
+#include <bit>
+#include <cmath>
+
+#include <emmintrin.h>
+
+#include "../support/error.hpp"
+
+namespace
+{
+	constexpr int kBins_ = 16;
+	constexpr int kStackSize_ = 64;
+
+	// Traversal pushes at most one node per level, so limiting the depth
+	// bounds the traversal stack.
+	constexpr std::uint32_t kMaxDepth_ = kStackSize_ - 2;
+
+	constexpr float kInf_ = std::numeric_limits<float>::infinity();
+
+	// Cost of a traversal step relative to testing four triangles. Leaves are
+	// tested four triangles at a time, so the SAH counts groups of four.
+	constexpr float kTraversalCost_ = 1.f;
+
+	inline float leaf_cost_(std::uint32_t aCount) noexcept
+	{
+		return float((aCount + 3) / 4);
+	}
+
+	struct Aabb_
+	{
+		Vec3f lo{ kInf_, kInf_, kInf_ };
+		Vec3f hi{ -kInf_, -kInf_, -kInf_ };
+
+		void grow(Vec3f const& aP) noexcept
+		{
+			lo = { std::min(lo.x, aP.x), std::min(lo.y, aP.y), std::min(lo.z, aP.z) };
+			hi = { std::max(hi.x, aP.x), std::max(hi.y, aP.y), std::max(hi.z, aP.z) };
+		}
+		void grow(Aabb_ const& aB) noexcept
+		{
+			lo = { std::min(lo.x, aB.lo.x), std::min(lo.y, aB.lo.y), std::min(lo.z, aB.lo.z) };
+			hi = { std::max(hi.x, aB.hi.x), std::max(hi.y, aB.hi.y), std::max(hi.z, aB.hi.z) };
+		}
+
+		float area() const noexcept
+		{
+			if (lo.x > hi.x)
+				return 0.f;
+
+			auto const e = hi - lo;
+			return 2.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+		}
+	};
+
+	struct BuildTriangle_
+	{
+		Aabb_ bounds;
+		Vec3f centroid;
+	};
+
+	struct Bin_
+	{
+		Aabb_ bounds;
+		std::uint32_t count = 0;
+	};
+
+	struct RangeInfo_
+	{
+		Aabb_ bounds;    // of the triangles
+		Aabb_ centroids; // of the triangle centroids
+	};
+
+	class Builder_
+	{
+		public:
+			Builder_(std::vector<BuildTriangle_> const& aTris, std::vector<std::uint32_t>& aIndices, BvhNode* aNodes, BvhBuildOptions const& aOpts)
+				: mTris(aTris), mIndices(aIndices), mNodes(aNodes), mOpts(aOpts)
+				, mThreads(aOpts.threads ? aOpts.threads : std::max(1u, std::thread::hardware_concurrency()))
+				, mParallelDepth(std::uint32_t(std::bit_width(mThreads) - 1))
+			{}
+
+			void build(std::uint32_t aNode, std::uint32_t aFirst, std::uint32_t aCount, std::uint32_t aDepth);
+
+			std::uint32_t node_count() const noexcept { return mNextNode.load(); }
+
+		private:
+			RangeInfo_ range_info_(std::uint32_t aFirst, std::uint32_t aCount, std::uint32_t aDepth) const;
+			void bin_(std::uint32_t aFirst, std::uint32_t aCount, std::uint32_t aDepth, Aabb_ const& aCentroids, Bin_ (&aBins)[3][kBins_]) const;
+
+			// Splits [aFirst, aFirst+aCount) into chunks and runs aFn on them
+			// in parallel if the range is large and the node at aDepth has
+			// threads to itself (see mParallelDepth).
+			template< typename tResult, typename tFn, typename tCombine >
+			tResult parallel_reduce_(std::uint32_t aFirst, std::uint32_t aCount, std::uint32_t aDepth, tFn&& aFn, tCombine&& aCombine) const;
+
+			std::vector<BuildTriangle_> const& mTris;
+			std::vector<std::uint32_t>& mIndices;
+			BvhNode* mNodes;
+			BvhBuildOptions mOpts;
+
+			// Subtrees are handed to other threads only above mParallelDepth
+			// = log2(mThreads), so at most mThreads build at once. A node at
+			// depth d shares the threads with up to 2^d others.
+			std::size_t mThreads;
+			std::uint32_t mParallelDepth;
+
+			// Node 0 is the root; node 1 is unused, so that sibling pairs
+			// start at even indices.
+			std::atomic<std::uint32_t> mNextNode{ 2 };
+	};
+
+	template< typename tResult, typename tFn, typename tCombine >
+	tResult Builder_::parallel_reduce_(std::uint32_t aFirst, std::uint32_t aCount, std::uint32_t aDepth, tFn&& aFn, tCombine&& aCombine) const
+	{
+		if (aCount < 4 * mOpts.parallelThreshold || aDepth >= mParallelDepth)
+			return aFn(aFirst, aCount);
+
+		auto const threads = std::uint32_t(mThreads >> aDepth);
+		auto const chunk = (aCount + threads - 1) / threads;
+
+		std::vector<std::future<tResult>> parts;
+		for (std::uint32_t begin = aFirst + chunk; begin < aFirst + aCount; begin += chunk)
+		{
+			auto const n = std::min(chunk, aFirst + aCount - begin);
+			parts.emplace_back(std::async(std::launch::async, [&aFn, begin, n] { return aFn(begin, n); }));
+		}
+
+		tResult ret = aFn(aFirst, std::min(chunk, aCount));
+		for (auto& part : parts)
+			aCombine(ret, part.get());
+
+		return ret;
+	}
+
+	RangeInfo_ Builder_::range_info_(std::uint32_t aFirst, std::uint32_t aCount, std::uint32_t aDepth) const
+	{
+		return parallel_reduce_<RangeInfo_>(aFirst, aCount, aDepth,
+			[this] (std::uint32_t aBegin, std::uint32_t aN) {
+				RangeInfo_ info;
+				for (std::uint32_t i = aBegin; i < aBegin + aN; ++i)
+				{
+					auto const& tri = mTris[mIndices[i]];
+					info.bounds.grow(tri.bounds);
+					info.centroids.grow(tri.centroid);
+				}
+				return info;
+			},
+			[] (RangeInfo_& aA, RangeInfo_ const& aB) {
+				aA.bounds.grow(aB.bounds);
+				aA.centroids.grow(aB.centroids);
+			}
+		);
+	}
+
+	void Builder_::bin_(std::uint32_t aFirst, std::uint32_t aCount, std::uint32_t aDepth, Aabb_ const& aCentroids, Bin_ (&aBins)[3][kBins_]) const
+	{
+		// All three axes are binned in one pass over the triangles. Axes
+		// without extent put everything into bin 0 and are skipped later.
+		float scale[3];
+		for (std::size_t axis = 0; axis < 3; ++axis)
+		{
+			float const extent = aCentroids.hi[axis] - aCentroids.lo[axis];
+			scale[axis] = extent > 0.f ? kBins_ / extent : 0.f;
+		}
+
+		struct Bins { Bin_ b[3][kBins_]; };
+
+		auto const bins = parallel_reduce_<Bins>(aFirst, aCount, aDepth,
+			[&] (std::uint32_t aBegin, std::uint32_t aN) {
+				Bins ret;
+				for (std::uint32_t i = aBegin; i < aBegin + aN; ++i)
+				{
+					auto const& tri = mTris[mIndices[i]];
+					for (std::size_t axis = 0; axis < 3; ++axis)
+					{
+						int const bin = std::min(kBins_ - 1, int((tri.centroid[axis] - aCentroids.lo[axis]) * scale[axis]));
+						ret.b[axis][bin].bounds.grow(tri.bounds);
+						++ret.b[axis][bin].count;
+					}
+				}
+				return ret;
+			},
+			[] (Bins& aA, Bins const& aB) {
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					for (int i = 0; i < kBins_; ++i)
+					{
+						aA.b[axis][i].bounds.grow(aB.b[axis][i].bounds);
+						aA.b[axis][i].count += aB.b[axis][i].count;
+					}
+				}
+			}
+		);
+
+		std::copy(&bins.b[0][0], &bins.b[0][0] + 3 * kBins_, &aBins[0][0]);
+	}
+
+	void Builder_::build(std::uint32_t aNode, std::uint32_t aFirst, std::uint32_t aCount, std::uint32_t aDepth)
+	{
+		auto const info = range_info_(aFirst, aCount, aDepth);
+
+		auto& node = mNodes[aNode];
+		node.boundsMin[0] = info.bounds.lo.x; node.boundsMin[1] = info.bounds.lo.y; node.boundsMin[2] = info.bounds.lo.z;
+		node.boundsMax[0] = info.bounds.hi.x; node.boundsMax[1] = info.bounds.hi.y; node.boundsMax[2] = info.bounds.hi.z;
+		node.leftOrFirst = aFirst;
+		node.count = aCount;
+
+		if (aCount <= 2 || aDepth >= kMaxDepth_)
+			return;
+
+		// Find the best split over all axes with binned SAH.
+		Bin_ allBins[3][kBins_];
+		bin_(aFirst, aCount, aDepth, info.centroids, allBins);
+
+		float bestCost = kInf_;
+		int bestAxis = -1, bestSplit = 0;
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (!(info.centroids.hi[std::size_t(axis)] > info.centroids.lo[std::size_t(axis)]))
+				continue;
+
+			auto const& bins = allBins[axis];
+
+			// Sweep from both sides; split s puts bins [0, s) on the left.
+			float rightArea[kBins_];
+			std::uint32_t rightCount[kBins_];
+			Aabb_ acc;
+			std::uint32_t n = 0;
+			for (int i = kBins_ - 1; i > 0; --i)
+			{
+				acc.grow(bins[i].bounds);
+				n += bins[i].count;
+				rightArea[i] = acc.area();
+				rightCount[i] = n;
+			}
+
+			acc = Aabb_{};
+			n = 0;
+			for (int s = 1; s < kBins_; ++s)
+			{
+				acc.grow(bins[s - 1].bounds);
+				n += bins[s - 1].count;
+				if (0 == n || 0 == rightCount[s])
+					continue;
+
+				float const cost = acc.area() * leaf_cost_(n) + rightArea[s] * leaf_cost_(rightCount[s]);
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = s;
+				}
+			}
+		}
+
+		// Compare against not splitting. Leaves larger than the maximum are
+		// only made if no split is possible (e.g., identical centroids).
+		float const area = info.bounds.area();
+		float const splitCost = kTraversalCost_ + (area > 0.f ? bestCost / area : 0.f);
+		if (bestAxis < 0 || (splitCost >= leaf_cost_(aCount) && aCount <= mOpts.maxLeafSize))
+			return;
+
+		float const cmin = info.centroids.lo[std::size_t(bestAxis)];
+		float const scale = kBins_ / (info.centroids.hi[std::size_t(bestAxis)] - cmin);
+		auto const begin = mIndices.begin() + aFirst;
+		auto const mid = std::partition(begin, begin + aCount, [&] (std::uint32_t aTri) {
+			return std::min(kBins_ - 1, int((mTris[aTri].centroid[std::size_t(bestAxis)] - cmin) * scale)) < bestSplit;
+		});
+
+		auto const leftCount = std::uint32_t(mid - begin);
+		if (0 == leftCount || aCount == leftCount)
+			return;
+
+		auto const children = mNextNode.fetch_add(2);
+		node.leftOrFirst = children;
+		node.count = 0;
+
+		if (aCount > mOpts.parallelThreshold && aDepth < mParallelDepth)
+		{
+			auto left = std::async(std::launch::async, [=, this] { build(children, aFirst, leftCount, aDepth + 1); });
+			build(children + 1, aFirst + leftCount, aCount - leftCount, aDepth + 1);
+			left.get();
+		}
+		else
+		{
+			build(children, aFirst, leftCount, aDepth + 1);
+			build(children + 1, aFirst + leftCount, aCount - leftCount, aDepth + 1);
+		}
+	}
+
+	std::size_t depth_(std::vector<BvhNode> const& aNodes, std::uint32_t aNode)
+	{
+		auto const& node = aNodes[aNode];
+		if (node.count)
+			return 1;
+
+		return 1 + std::max(depth_(aNodes, node.leftOrFirst), depth_(aNodes, node.leftOrFirst + 1));
+	}
+
+	// SSE helpers
+	inline __m128 select_(__m128 aMask, __m128 aA, __m128 aB) noexcept
+	{
+		return _mm_or_ps(_mm_and_ps(aMask, aA), _mm_andnot_ps(aMask, aB));
+	}
+
+	inline float hmin_(__m128 aV) noexcept
+	{
+		aV = _mm_min_ps(aV, _mm_shuffle_ps(aV, aV, _MM_SHUFFLE(2, 3, 0, 1)));
+		aV = _mm_min_ps(aV, _mm_shuffle_ps(aV, aV, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(aV);
+	}
+	inline float hmax_(__m128 aV) noexcept
+	{
+		aV = _mm_max_ps(aV, _mm_shuffle_ps(aV, aV, _MM_SHUFFLE(2, 3, 0, 1)));
+		aV = _mm_max_ps(aV, _mm_shuffle_ps(aV, aV, _MM_SHUFFLE(1, 0, 3, 2)));
+		return _mm_cvtss_f32(aV);
+	}
+
+	// Single ray, prepared for slab tests. Lane 3 is unused.
+	struct RaySse_
+	{
+		__m128 origin;
+		__m128 invDir;
+	};
+
+	// Entry and exit distances of one slab, from the distances t0 and t1 to
+	// its planes. If the ray runs parallel to the slab with its origin on one
+	// of the planes, the distance to that plane is 0 * inf = NaN; the ray is
+	// inside the slab (bounds are inclusive), so it must not limit the range.
+	// min/max return their second operand if either is NaN, which would drop
+	// the box; NaN lanes are therefore replaced by -inf/+inf.
+	inline void slab_(__m128 aT0, __m128 aT1, __m128& aNear, __m128& aFar) noexcept
+	{
+		static __m128 const kNegInf = _mm_set1_ps(-kInf_);
+		static __m128 const kPosInf = _mm_set1_ps(kInf_);
+
+		__m128 const nan = _mm_cmpunord_ps(aT0, aT1);
+		aNear = select_(nan, kNegInf, _mm_min_ps(aT0, aT1));
+		aFar = select_(nan, kPosInf, _mm_max_ps(aT0, aT1));
+	}
+
+	// Returns the entry distance, or infinity if the box is missed or further
+	// away than aTMax.
+	inline float hit_box_(BvhNode const& aNode, RaySse_ const& aRay, float aTMax) noexcept
+	{
+		// Lane 3 of the loads holds leftOrFirst/count; it is replaced by
+		// -inf/+inf so that it does not affect the horizontal min/max.
+		static __m128 const kLanes = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+		static __m128 const kNegInf = _mm_set1_ps(-kInf_);
+		static __m128 const kPosInf = _mm_set1_ps(kInf_);
+
+		__m128 const t0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(aNode.boundsMin), aRay.origin), aRay.invDir);
+		__m128 const t1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(aNode.boundsMax), aRay.origin), aRay.invDir);
+
+		// NaN lanes (see slab_) are dropped along with lane 3.
+		__m128 const lanes = _mm_andnot_ps(_mm_cmpunord_ps(t0, t1), kLanes);
+
+		float const tnear = std::max(hmax_(select_(lanes, _mm_min_ps(t0, t1), kNegInf)), 0.f);
+		float const tfar = std::min(hmin_(select_(lanes, _mm_max_ps(t0, t1), kPosInf)), aTMax);
+		return tnear <= tfar ? tnear : kInf_;
+	}
+
+	// Four rays (structure of arrays).
+	struct Packet_
+	{
+		__m128 ox, oy, oz;
+		__m128 dx, dy, dz;
+		__m128 ix, iy, iz;
+	};
+
+	// Returns the mask of rays that hit the box before their current tMax,
+	// and their entry distances in aTNear.
+	inline int hit_box4_(BvhNode const& aNode, Packet_ const& aP, __m128 aTMax, __m128& aTNear) noexcept
+	{
+		__m128 const x0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aNode.boundsMin[0]), aP.ox), aP.ix);
+		__m128 const x1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aNode.boundsMax[0]), aP.ox), aP.ix);
+		__m128 const y0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aNode.boundsMin[1]), aP.oy), aP.iy);
+		__m128 const y1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aNode.boundsMax[1]), aP.oy), aP.iy);
+		__m128 const z0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aNode.boundsMin[2]), aP.oz), aP.iz);
+		__m128 const z1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(aNode.boundsMax[2]), aP.oz), aP.iz);
+
+		__m128 nx, fx, ny, fy, nz, fz;
+		slab_(x0, x1, nx, fx);
+		slab_(y0, y1, ny, fy);
+		slab_(z0, z1, nz, fz);
+
+		__m128 tnear = _mm_max_ps(_mm_max_ps(nx, ny), _mm_max_ps(nz, _mm_setzero_ps()));
+		__m128 tfar = _mm_min_ps(_mm_min_ps(fx, fy), _mm_min_ps(fz, aTMax));
+
+		aTNear = tnear;
+		return _mm_movemask_ps(_mm_cmple_ps(tnear, tfar));
+	}
+
+	inline __m128 abs_(__m128 aV) noexcept
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.f), aV);
+	}
+
+	constexpr float kDetEpsilon_ = 1e-12f;
+}
+
+TriangleBvh::TriangleBvh(SimpleMeshData const& aMesh, BvhBuildOptions const& aOpts)
+{
+	if (aMesh.positions.size() % 3)
+		throw Error("TriangleBvh: vertex count (%zu) is not a multiple of three", aMesh.positions.size());
+
+	auto const triCount = aMesh.positions.size() / 3;
+	if (triCount >= (std::size_t(1) << 31))
+		throw Error("TriangleBvh: too many triangles (%zu)", triCount);
+	if (0 == triCount)
+		return;
+
+	std::vector<BuildTriangle_> tris(triCount);
+	for (std::size_t i = 0; i < triCount; ++i)
+	{
+		auto const& p0 = aMesh.positions[i * 3 + 0];
+		auto const& p1 = aMesh.positions[i * 3 + 1];
+		auto const& p2 = aMesh.positions[i * 3 + 2];
+
+		tris[i].bounds.grow(p0);
+		tris[i].bounds.grow(p1);
+		tris[i].bounds.grow(p2);
+		tris[i].centroid = (p0 + p1 + p2) * (1.f / 3.f);
+	}
+
+	std::vector<std::uint32_t> indices(triCount);
+	for (std::size_t i = 0; i < triCount; ++i)
+		indices[i] = std::uint32_t(i);
+
+	// Worst case, with single-triangle leaves. Left uninitialized, so that
+	// the untouched part is never committed.
+	std::unique_ptr<BvhNode[]> nodes(new BvhNode[2 * triCount + 2]);
+
+	Builder_ builder(tris, indices, nodes.get(), aOpts);
+	builder.build(0, 0, std::uint32_t(triCount), 0);
+
+	mNodes.assign(nodes.get(), nodes.get() + builder.node_count());
+	mNodes[1] = BvhNode{};
+
+	// Leaf triangles in traversal order. Padded by three entries, so that the
+	// four-wide loads at the end of the last leaf stay in bounds.
+	for (int c = 0; c < 3; ++c)
+	{
+		mV0[c].assign(triCount + 3, 0.f);
+		mE1[c].assign(triCount + 3, 0.f);
+		mE2[c].assign(triCount + 3, 0.f);
+	}
+
+	for (std::size_t i = 0; i < triCount; ++i)
+	{
+		auto const tri = indices[i];
+		auto const& p0 = aMesh.positions[tri * 3 + 0];
+		auto const e1 = aMesh.positions[tri * 3 + 1] - p0;
+		auto const e2 = aMesh.positions[tri * 3 + 2] - p0;
+		for (std::size_t c = 0; c < 3; ++c)
+		{
+			mV0[c][i] = p0[c];
+			mE1[c][i] = e1[c];
+			mE2[c][i] = e2[c];
+		}
+	}
+
+	mTriangleIds = std::move(indices);
+}
+
+RayHit TriangleBvh::intersect(Ray const& aRay) const noexcept
+{
+	RayHit hit;
+	hit.t = aRay.tMax;
+
+	if (mNodes.empty())
+		return RayHit{};
+
+	RaySse_ const ray{
+		_mm_set_ps(0.f, aRay.origin.z, aRay.origin.y, aRay.origin.x),
+		_mm_set_ps(0.f, 1.f / aRay.direction.z, 1.f / aRay.direction.y, 1.f / aRay.direction.x)
+	};
+
+	__m128 const ox = _mm_set1_ps(aRay.origin.x), oy = _mm_set1_ps(aRay.origin.y), oz = _mm_set1_ps(aRay.origin.z);
+	__m128 const dx = _mm_set1_ps(aRay.direction.x), dy = _mm_set1_ps(aRay.direction.y), dz = _mm_set1_ps(aRay.direction.z);
+
+	std::uint32_t stack[kStackSize_];
+	int top = 0;
+
+	if (hit_box_(mNodes[0], ray, hit.t) < kInf_)
+		stack[top++] = 0;
+
+	while (top)
+	{
+		auto const& node = mNodes[stack[--top]];
+
+		if (node.count)
+		{
+			// Four triangles at a time.
+			for (std::uint32_t i = 0; i < node.count; i += 4)
+			{
+				auto const base = node.leftOrFirst + i;
+
+				__m128 const e1x = _mm_loadu_ps(&mE1[0][base]), e1y = _mm_loadu_ps(&mE1[1][base]), e1z = _mm_loadu_ps(&mE1[2][base]);
+				__m128 const e2x = _mm_loadu_ps(&mE2[0][base]), e2y = _mm_loadu_ps(&mE2[1][base]), e2z = _mm_loadu_ps(&mE2[2][base]);
+
+				// Moeller-Trumbore
+				__m128 const px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+				__m128 const py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+				__m128 const pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+
+				__m128 const det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+				__m128 const invDet = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+				__m128 const tx = _mm_sub_ps(ox, _mm_loadu_ps(&mV0[0][base]));
+				__m128 const ty = _mm_sub_ps(oy, _mm_loadu_ps(&mV0[1][base]));
+				__m128 const tz = _mm_sub_ps(oz, _mm_loadu_ps(&mV0[2][base]));
+
+				__m128 const u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+				__m128 const qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+				__m128 const qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+				__m128 const qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+				__m128 const v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+				__m128 const t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+				__m128 mask = _mm_cmpgt_ps(abs_(det), _mm_set1_ps(kDetEpsilon_));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(u, _mm_setzero_ps()));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(v, _mm_setzero_ps()));
+				mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+				mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_setzero_ps()));
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(t, _mm_set1_ps(hit.t)));
+
+				int bits = _mm_movemask_ps(mask);
+				if (node.count - i < 4)
+					bits &= (1 << (node.count - i)) - 1;
+				if (!bits)
+					continue;
+
+				alignas(16) float ts[4], us[4], vs[4];
+				_mm_store_ps(ts, t);
+				_mm_store_ps(us, u);
+				_mm_store_ps(vs, v);
+				for (int lane = 0; lane < 4; ++lane)
+				{
+					if ((bits & (1 << lane)) && ts[lane] < hit.t)
+					{
+						hit.t = ts[lane];
+						hit.u = us[lane];
+						hit.v = vs[lane];
+						hit.triangle = mTriangleIds[base + std::uint32_t(lane)];
+					}
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first.
+		auto const left = node.leftOrFirst;
+		float const tl = hit_box_(mNodes[left], ray, hit.t);
+		float const tr = hit_box_(mNodes[left + 1], ray, hit.t);
+
+		if (tl <= tr)
+		{
+			if (tr < kInf_) stack[top++] = left + 1;
+			if (tl < kInf_) stack[top++] = left;
+		}
+		else
+		{
+			if (tl < kInf_) stack[top++] = left;
+			if (tr < kInf_) stack[top++] = left + 1;
+		}
+	}
+
+	if (!hit)
+		return RayHit{};
+
+	return hit;
+}
+
+void TriangleBvh::intersect4(Ray const (&aRays)[4], RayHit (&aHits)[4]) const noexcept
+{
+	for (int i = 0; i < 4; ++i)
+		aHits[i] = RayHit{};
+
+	if (mNodes.empty())
+		return;
+
+	Packet_ p;
+	p.ox = _mm_setr_ps(aRays[0].origin.x, aRays[1].origin.x, aRays[2].origin.x, aRays[3].origin.x);
+	p.oy = _mm_setr_ps(aRays[0].origin.y, aRays[1].origin.y, aRays[2].origin.y, aRays[3].origin.y);
+	p.oz = _mm_setr_ps(aRays[0].origin.z, aRays[1].origin.z, aRays[2].origin.z, aRays[3].origin.z);
+	p.dx = _mm_setr_ps(aRays[0].direction.x, aRays[1].direction.x, aRays[2].direction.x, aRays[3].direction.x);
+	p.dy = _mm_setr_ps(aRays[0].direction.y, aRays[1].direction.y, aRays[2].direction.y, aRays[3].direction.y);
+	p.dz = _mm_setr_ps(aRays[0].direction.z, aRays[1].direction.z, aRays[2].direction.z, aRays[3].direction.z);
+	p.ix = _mm_div_ps(_mm_set1_ps(1.f), p.dx);
+	p.iy = _mm_div_ps(_mm_set1_ps(1.f), p.dy);
+	p.iz = _mm_div_ps(_mm_set1_ps(1.f), p.dz);
+
+	__m128 tBest = _mm_setr_ps(aRays[0].tMax, aRays[1].tMax, aRays[2].tMax, aRays[3].tMax);
+	__m128 uBest = _mm_setzero_ps(), vBest = _mm_setzero_ps();
+	__m128i idBest = _mm_set1_epi32(-1);
+
+	std::uint32_t stack[kStackSize_];
+	int top = 0;
+
+	__m128 tnear;
+	if (hit_box4_(mNodes[0], p, tBest, tnear))
+		stack[top++] = 0;
+
+	while (top)
+	{
+		auto const& node = mNodes[stack[--top]];
+
+		if (node.count)
+		{
+			// One triangle against the four rays at a time.
+			for (std::uint32_t i = 0; i < node.count; ++i)
+			{
+				auto const idx = node.leftOrFirst + i;
+
+				__m128 const e1x = _mm_set1_ps(mE1[0][idx]), e1y = _mm_set1_ps(mE1[1][idx]), e1z = _mm_set1_ps(mE1[2][idx]);
+				__m128 const e2x = _mm_set1_ps(mE2[0][idx]), e2y = _mm_set1_ps(mE2[1][idx]), e2z = _mm_set1_ps(mE2[2][idx]);
+
+				__m128 const px = _mm_sub_ps(_mm_mul_ps(p.dy, e2z), _mm_mul_ps(p.dz, e2y));
+				__m128 const py = _mm_sub_ps(_mm_mul_ps(p.dz, e2x), _mm_mul_ps(p.dx, e2z));
+				__m128 const pz = _mm_sub_ps(_mm_mul_ps(p.dx, e2y), _mm_mul_ps(p.dy, e2x));
+
+				__m128 const det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+				__m128 const invDet = _mm_div_ps(_mm_set1_ps(1.f), det);
+
+				__m128 const tx = _mm_sub_ps(p.ox, _mm_set1_ps(mV0[0][idx]));
+				__m128 const ty = _mm_sub_ps(p.oy, _mm_set1_ps(mV0[1][idx]));
+				__m128 const tz = _mm_sub_ps(p.oz, _mm_set1_ps(mV0[2][idx]));
+
+				__m128 const u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+
+				__m128 const qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+				__m128 const qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+				__m128 const qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+
+				__m128 const v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(p.dx, qx), _mm_mul_ps(p.dy, qy)), _mm_mul_ps(p.dz, qz)), invDet);
+				__m128 const t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+				__m128 mask = _mm_cmpgt_ps(abs_(det), _mm_set1_ps(kDetEpsilon_));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(u, _mm_setzero_ps()));
+				mask = _mm_and_ps(mask, _mm_cmpge_ps(v, _mm_setzero_ps()));
+				mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.f)));
+				mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, _mm_setzero_ps()));
+				mask = _mm_and_ps(mask, _mm_cmplt_ps(t, tBest));
+
+				tBest = select_(mask, t, tBest);
+				uBest = select_(mask, u, uBest);
+				vBest = select_(mask, v, vBest);
+				idBest = _mm_castps_si128(select_(mask, _mm_castsi128_ps(_mm_set1_epi32(int(mTriangleIds[idx]))), _mm_castsi128_ps(idBest)));
+			}
+			continue;
+		}
+
+		// Visit the child that is nearer for the active rays first.
+		auto const left = node.leftOrFirst;
+		__m128 tl, tr;
+		int const ml = hit_box4_(mNodes[left], p, tBest, tl);
+		int const mr = hit_box4_(mNodes[left + 1], p, tBest, tr);
+
+		float const nl = ml ? hmin_(select_(_mm_cmple_ps(tl, tBest), tl, _mm_set1_ps(kInf_))) : kInf_;
+		float const nr = mr ? hmin_(select_(_mm_cmple_ps(tr, tBest), tr, _mm_set1_ps(kInf_))) : kInf_;
+
+		if (nl <= nr)
+		{
+			if (mr) stack[top++] = left + 1;
+			if (ml) stack[top++] = left;
+		}
+		else
+		{
+			if (ml) stack[top++] = left;
+			if (mr) stack[top++] = left + 1;
+		}
+	}
+
+	alignas(16) float ts[4], us[4], vs[4];
+	alignas(16) std::int32_t ids[4];
+	_mm_store_ps(ts, tBest);
+	_mm_store_ps(us, uBest);
+	_mm_store_ps(vs, vBest);
+	_mm_store_si128(reinterpret_cast<__m128i*>(ids), idBest);
+
+	for (int i = 0; i < 4; ++i)
+	{
+		if (ids[i] < 0)
+			continue;
+
+		aHits[i].t = ts[i];
+		aHits[i].u = us[i];
+		aHits[i].v = vs[i];
+		aHits[i].triangle = std::uint32_t(ids[i]);
+	}
+}
+
+std::size_t TriangleBvh::node_count() const noexcept
+{
+	return mNodes.size();
+}
+std::size_t TriangleBvh::triangle_count() const noexcept
+{
+	return mTriangleIds.size();
+}
+std::size_t TriangleBvh::depth() const noexcept
+{
+	return mNodes.empty() ? 0 : depth_(mNodes, 0);
+}
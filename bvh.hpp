@@ -0,0 +1,91 @@
+#ifndef BVH_HPP_B5EF7A67_D348_4E2C_90F1_67D90FBE6057
+#define BVH_HPP_B5EF7A67_D348_4E2C_90F1_67D90FBE6057
+
+#include <limits>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+
+#include "simple_mesh.hpp"
+
+/* Triangle bounding volume hierarchy for ray queries.
+ *
+ * Built from the triangle soup in SimpleMeshData::positions (three vertices
+ * per triangle) with a binned surface area heuristic (SAH). Large subtrees
+ * near the root are built in parallel, using no more threads than cores.
+ *
+ * Nodes are 32 bytes; two fit in a cache line. The children of a node are
+ * stored next to each other, and sibling pairs start on even indices, so a
+ * pair shares one 64-byte line. Leaf triangles are stored in traversal
+ * order as structure-of-arrays (vertex 0 and two edges), which allows testing
+ * four triangles against one ray, or one triangle against four rays, with
+ * SSE.
+ *
+ * Queries report triangles by their index in the original mesh (i.e.,
+ * first vertex / 3).
+ */
+
+struct Ray
+{
+	Vec3f origin;
+	Vec3f direction;  // need not be normalized; t is in units of direction
+	float tMax = std::numeric_limits<float>::infinity();
+};
+
+inline constexpr std::uint32_t kNoHit = ~std::uint32_t(0);
+
+struct RayHit
+{
+	float t = std::numeric_limits<float>::infinity();
+	std::uint32_t triangle = kNoHit;
+	float u = 0.f, v = 0.f;  // barycentrics of vertices 1 and 2
+
+	explicit operator bool() const noexcept { return kNoHit != triangle; }
+};
+
+struct BvhNode
+{
+	float boundsMin[3];
+	std::uint32_t leftOrFirst;  // inner: left child (right = left+1); leaf: first triangle
+	float boundsMax[3];
+	std::uint32_t count;        // number of triangles; 0 for inner nodes
+};
+
+static_assert(sizeof(BvhNode) == 32);
+
+struct BvhBuildOptions
+{
+	std::size_t maxLeafSize = 8;
+	std::size_t parallelThreshold = 1 << 15; // subtrees larger than this go to another thread
+	std::size_t threads = 0;                 // at most this many at once; 0: one per core
+};
+
+class TriangleBvh
+{
+	public:
+		TriangleBvh() = default;
+		explicit TriangleBvh(SimpleMeshData const&, BvhBuildOptions const& = {});
+
+	public:
+		RayHit intersect(Ray const&) const noexcept;
+
+		// Intersects four rays at once. Works best if the rays are coherent
+		// (similar origins and directions), e.g., neighbouring pixels.
+		void intersect4(Ray const (&aRays)[4], RayHit (&aHits)[4]) const noexcept;
+
+		std::size_t node_count() const noexcept;
+		std::size_t triangle_count() const noexcept;
+		std::size_t depth() const noexcept;
+
+	private:
+		std::vector<BvhNode> mNodes;
+
+		// Leaf triangles, in leaf order; see above.
+		std::vector<float> mV0[3], mE1[3], mE2[3];
+		std::vector<std::uint32_t> mTriangleIds;
+};
+
+#endif // BVH_HPP_B5EF7A67_D348_4E2C_90F1_67D90FBE6057
@@ -0,0 +1,285 @@
+#include "capture.hpp"
+
+#include <algorithm>
+
+#include <cstdio>
+#include <cstring>
+
+#include "stb_image_write.h"
+
+namespace
+{
+	// Converts bottom-up RGBA (as returned by glReadPixels) into top-down RGB.
+	std::vector<unsigned char> to_rgb_top_down_(std::vector<unsigned char> const& aRgba, GLsizei aWidth, GLsizei aHeight)
+	{
+		auto const w = std::size_t(aWidth), h = std::size_t(aHeight);
+
+		std::vector<unsigned char> ret(w * h * 3);
+		for (std::size_t y = 0; y < h; ++y)
+		{
+			auto const* src = aRgba.data() + (h - 1 - y) * w * 4;
+			auto* dst = ret.data() + y * w * 3;
+			for (std::size_t x = 0; x < w; ++x)
+			{
+				dst[x * 3 + 0] = src[x * 4 + 0];
+				dst[x * 3 + 1] = src[x * 4 + 1];
+				dst[x * 3 + 2] = src[x * 4 + 2];
+			}
+		}
+
+		return ret;
+	}
+
+	bool write_ppm_(char const* aPath, GLsizei aWidth, GLsizei aHeight, std::vector<unsigned char> const& aRgb)
+	{
+		std::FILE* file = std::fopen(aPath, "wb");
+		if (!file)
+			return false;
+
+		std::fprintf(file, "P6\n%d %d\n255\n", int(aWidth), int(aHeight));
+		bool const ok = aRgb.size() == std::fwrite(aRgb.data(), 1, aRgb.size(), file);
+		return 0 == std::fclose(file) && ok;
+	}
+}
+
+FrameCapture::FrameCapture(bool aDropWhenBusy, std::size_t aWorkers, std::size_t aRingSize, std::size_t aMaxInFlight)
+	: mSlots(std::max<std::size_t>(aRingSize, 1))
+	, mMaxInFlight(std::max<std::size_t>(aMaxInFlight, 1))
+	, mDropWhenBusy(aDropWhenBusy)
+{
+	for (auto& slot : mSlots)
+		glGenBuffers(1, &slot.pbo);
+
+	if (0 == aWorkers)
+	{
+		auto const hw = std::thread::hardware_concurrency();
+		aWorkers = hw > 1 ? hw - 1 : 1;
+	}
+
+	for (std::size_t i = 0; i < aWorkers; ++i)
+		mWorkers.emplace_back([this] { worker_(); });
+}
+
+FrameCapture::~FrameCapture()
+{
+	flush();
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mJobReady.notify_all();
+
+	for (auto& worker : mWorkers)
+		worker.join();
+
+	for (auto& slot : mSlots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+		glDeleteBuffers(1, &slot.pbo);
+	}
+}
+
+void FrameCapture::capture(GLsizei aWidth, GLsizei aHeight, std::string aPath, CaptureFormat aFormat)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		++mStats.requested;
+	}
+
+	// If the ring has wrapped around, the oldest read-back must complete
+	// first. It was issued several frames ago, so this rarely waits. When
+	// dropping frames is allowed, never block the render loop on it; drop
+	// the new frame instead.
+	auto& slot = mSlots[mNextSlot];
+	if (slot.fence)
+	{
+		if (!resolve_(slot, !mDropWhenBusy))
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			++mStats.dropped;
+			return;
+		}
+
+		--mPendingSlots;
+	}
+
+	auto const size = GLsizeiptr(aWidth) * aHeight * 4;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	if (slot.size != size)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+		slot.size = size;
+	}
+
+	// Tightly packed rows; restore the caller's setting afterwards, so that
+	// other read-backs are not affected.
+	GLint packAlignment = 4;
+	glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, aWidth, aHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.width = aWidth;
+	slot.height = aHeight;
+	slot.path = std::move(aPath);
+	slot.format = aFormat;
+
+	mNextSlot = (mNextSlot + 1) % mSlots.size();
+	++mPendingSlots;
+}
+
+void FrameCapture::poll()
+{
+	// Oldest first; read-backs complete in order, so stop at the first one
+	// that is not ready yet.
+	while (mPendingSlots)
+	{
+		auto const oldest = (mNextSlot + mSlots.size() - mPendingSlots) % mSlots.size();
+		if (!resolve_(mSlots[oldest], false))
+			break;
+
+		--mPendingSlots;
+	}
+}
+
+void FrameCapture::flush()
+{
+	while (mPendingSlots)
+	{
+		auto const oldest = (mNextSlot + mSlots.size() - mPendingSlots) % mSlots.size();
+		resolve_(mSlots[oldest], true);
+		--mPendingSlots;
+	}
+
+	std::unique_lock<std::mutex> lock(mMutex);
+	mJobDone.wait(lock, [this] { return 0 == mBuffersInUse; });
+}
+
+bool FrameCapture::pending() const noexcept
+{
+	return 0 != mPendingSlots;
+}
+
+CaptureStats FrameCapture::stats() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mStats;
+}
+
+bool FrameCapture::resolve_(Slot_& aSlot, bool aWait)
+{
+	if (aWait)
+	{
+		while (GL_TIMEOUT_EXPIRED == glClientWaitSync(aSlot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000))
+			;
+	}
+	else
+	{
+		auto const res = glClientWaitSync(aSlot.fence, 0, 0);
+		if (GL_ALREADY_SIGNALED != res && GL_CONDITION_SATISFIED != res)
+			return false;
+	}
+
+	glDeleteSync(aSlot.fence);
+	aSlot.fence = nullptr;
+
+	// Grab a CPU-side buffer. If too many are in flight, drop the frame or
+	// wait for a worker to finish one.
+	std::vector<unsigned char> pixels;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		if (mBuffersInUse >= mMaxInFlight)
+		{
+			if (mDropWhenBusy)
+			{
+				++mStats.dropped;
+				return true;
+			}
+
+			mJobDone.wait(lock, [this] { return mBuffersInUse < mMaxInFlight; });
+		}
+
+		++mBuffersInUse;
+		if (!mFreeBuffers.empty())
+		{
+			pixels = std::move(mFreeBuffers.back());
+			mFreeBuffers.pop_back();
+		}
+	}
+
+	pixels.resize(std::size_t(aSlot.size));
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, aSlot.pbo);
+	void const* ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, aSlot.size, GL_MAP_READ_BIT);
+	if (ptr)
+	{
+		std::memcpy(pixels.data(), ptr, pixels.size());
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	// Nothing was read back; don't write out whatever the buffer held.
+	if (!ptr)
+	{
+		std::fprintf(stderr, "Frame capture: unable to map read-back buffer for '%s'\n", aSlot.path.c_str());
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			++mStats.failed;
+
+			mFreeBuffers.emplace_back(std::move(pixels));
+			--mBuffersInUse;
+		}
+		mJobDone.notify_all();
+		return true;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobs.push_back({ std::move(pixels), aSlot.width, aSlot.height, std::move(aSlot.path), aSlot.format });
+	}
+	mJobReady.notify_one();
+
+	return true;
+}
+
+void FrameCapture::worker_()
+{
+	for (;;)
+	{
+		Job_ job;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mJobReady.wait(lock, [this] { return mStop || !mJobs.empty(); });
+			if (mJobs.empty())
+				return;
+
+			job = std::move(mJobs.front());
+			mJobs.pop_front();
+		}
+
+		auto const rgb = to_rgb_top_down_(job.pixels, job.width, job.height);
+
+		bool ok = false;
+		if (CaptureFormat::png == job.format)
+			ok = 0 != stbi_write_png(job.path.c_str(), job.width, job.height, 3, rgb.data(), job.width * 3);
+		else
+			ok = write_ppm_(job.path.c_str(), job.width, job.height, rgb);
+
+		if (!ok)
+			std::fprintf(stderr, "Frame capture: unable to write '%s'\n", job.path.c_str());
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			++(ok ? mStats.written : mStats.failed);
+
+			mFreeBuffers.emplace_back(std::move(job.pixels));
+			--mBuffersInUse;
+		}
+		mJobDone.notify_all();
+	}
+}
@@ -0,0 +1,110 @@
+#ifndef CAPTURE_HPP_97F3224E_5A3C_4985_B7C3_E6DE4829CEE2
+#define CAPTURE_HPP_97F3224E_5A3C_4985_B7C3_E6DE4829CEE2
+
+#include <glad/glad.h>
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <condition_variable>
+
+/* Asynchronous frame capture.
+ *
+ * capture() starts a glReadPixels() into a pixel pack buffer (PBO) and sets a
+ * fence; it does not wait for the GPU. poll() maps the PBOs whose fences have
+ * signalled (usually a few frames later), copies the pixels out and hands
+ * them to a pool of worker threads for encoding and writing.
+ *
+ * Memory is bounded: there are a fixed number of PBOs, and a fixed number of
+ * CPU-side frame buffers in flight. If the workers fall behind and all
+ * buffers are in use, frames are dropped (and counted) rather than stalling
+ * the render loop. Offline uses (e.g., reference images for tests) can
+ * instead choose to wait, so that no frame is lost.
+ */
+
+enum class CaptureFormat
+{
+	png,
+	raw    // binary PPM; uncompressed and much faster to write than PNG
+};
+
+struct CaptureStats
+{
+	std::size_t requested = 0;
+	std::size_t written = 0;
+	std::size_t dropped = 0;
+	std::size_t failed = 0;
+};
+
+class FrameCapture
+{
+	public:
+		// aWorkers == 0 selects one less than the number of hardware threads.
+		explicit FrameCapture(bool aDropWhenBusy = true, std::size_t aWorkers = 0, std::size_t aRingSize = 4, std::size_t aMaxInFlight = 8);
+		~FrameCapture();
+
+		FrameCapture(FrameCapture const&) = delete;
+		FrameCapture& operator=(FrameCapture const&) = delete;
+
+	public:
+		// Reads back the current read framebuffer (the back buffer, unless an
+		// FBO is bound), i.e., call this after drawing and before swapping.
+		void capture(GLsizei aWidth, GLsizei aHeight, std::string aPath, CaptureFormat);
+
+		// Hands completed read-backs to the workers. Call once per frame.
+		void poll();
+
+		// Waits until all pending captures have been written.
+		void flush();
+
+		// True if read-backs are waiting for the GPU, i.e., poll() still has
+		// work to do.
+		bool pending() const noexcept;
+
+		CaptureStats stats() const;
+
+	private:
+		struct Slot_
+		{
+			GLuint pbo = 0;
+			GLsizeiptr size = 0;
+			GLsync fence = nullptr;
+
+			GLsizei width = 0, height = 0;
+			std::string path;
+			CaptureFormat format = CaptureFormat::png;
+		};
+
+		struct Job_
+		{
+			std::vector<unsigned char> pixels; // RGBA8, bottom row first
+			GLsizei width, height;
+			std::string path;
+			CaptureFormat format;
+		};
+
+		bool resolve_(Slot_&, bool aWait);
+		void worker_();
+
+		std::vector<Slot_> mSlots;
+		std::size_t mNextSlot = 0;
+		std::size_t mPendingSlots = 0;
+
+		mutable std::mutex mMutex;
+		std::condition_variable mJobReady, mJobDone;
+		std::deque<Job_> mJobs;
+		std::vector<std::vector<unsigned char>> mFreeBuffers;
+		std::size_t mBuffersInUse = 0;
+		std::size_t mMaxInFlight;
+		bool mDropWhenBusy;
+		bool mStop = false;
+
+		CaptureStats mStats;
+
+		std::vector<std::thread> mWorkers;
+};
+
+#endif // CAPTURE_HPP_97F3224E_5A3C_4985_B7C3_E6DE4829CEE2
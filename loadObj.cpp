@@ -13,10 +13,42 @@ SimpleMeshData load_wavefront_obj(char const* aPath)
 
     SimpleMeshData ret;
 
+    // Materials. Texture paths in the MTL file are relative to the OBJ file.
+    auto const baseDir = std::filesystem::path(aPath).parent_path();
+    for (const auto& mat : result.materials)
+    {
+        SimpleMaterial material;
+        material.name = mat.name;
+        material.diffuse = Vec3f{ mat.diffuse[0], mat.diffuse[1], mat.diffuse[2] };
+        if (!mat.diffuse_texname.empty())
+            material.diffuseTexture = (baseDir / mat.diffuse_texname).lexically_normal().string();
+        ret.materials.emplace_back(std::move(material));
+    }
+
+    // Faces without a material get a white, untextured default material.
+    // It is only added if needed.
+    constexpr std::uint32_t kNoMaterial = ~std::uint32_t(0);
+    std::uint32_t defaultMaterial = kNoMaterial;
+    auto const default_material = [&] {
+        if (kNoMaterial == defaultMaterial)
+        {
+            defaultMaterial = std::uint32_t(ret.materials.size());
+            ret.materials.emplace_back(SimpleMaterial{ "default", Vec3f{ 1.0f, 1.0f, 1.0f }, {} });
+        }
+        return defaultMaterial;
+    };
+
     for (const auto& shape : result.shapes)
     {
-        for (const auto& idx : shape.mesh.indices)
+        // After triangulation, every face has exactly three indices.
+        for (std::size_t i = 0; i < shape.mesh.indices.size(); ++i)
         {
+            const auto& idx = shape.mesh.indices[i];
+
+            const auto face = i / 3;
+            const bool hasMaterial = face < shape.mesh.material_ids.size() && shape.mesh.material_ids[face] >= 0;
+            const auto materialId = hasMaterial ? std::uint32_t(shape.mesh.material_ids[face]) : default_material();
+
             // Vertex position
             ret.positions.emplace_back(Vec3f{
                 result.attributes.positions[idx.position_index * 3 + 0],
@@ -53,8 +85,9 @@ SimpleMeshData load_wavefront_obj(char const* aPath)
                 ret.texcoords.emplace_back(Vec2f{ 0.0f, 0.0f });
             }
 
-            // Default color
-            ret.colors.emplace_back(Vec3f{ 1.0f, 1.0f, 1.0f });
+            // Colour from the material's diffuse colour
+            ret.colors.emplace_back(ret.materials[materialId].diffuse);
+            ret.materialIds.emplace_back(materialId);
         }
     }
 
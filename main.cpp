@@ -1,16 +1,19 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
-#include "stb_image.h"
-
-
-
+#include <future>
+#include <limits>
+#include <memory>
+#include <string>
+#include <thread>
+#include <chrono>
 #include <numbers>
 #include <typeinfo>
 #include <stdexcept>
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include "../support/error.hpp"
 #include "../support/program.hpp"
@@ -23,6 +26,12 @@
 
 #include "defaults.hpp"
 #include "loadObj.hpp"
+#include "particles.hpp"
+#include "material.hpp"
+#include "capture.hpp"
+#include "bvh.hpp"
+#include "utilization.hpp"
+#include "occlusion.hpp"
 #include <algorithm>
 
 
@@ -37,6 +46,114 @@ namespace
 
 	constexpr char const* kWindowTitle = "COMP3811 - CW2";
 
+	constexpr Vec3f kRocketPosition_{ 0.f, 5.f, -10.f };
+
+	// Camera collision. The camera stops this far in front of surfaces, and
+	// is kept at least kCameraEyeHeight_ above the ground below it.
+	constexpr float kCameraClearance_ = 0.05f;
+	constexpr float kCameraEyeHeight_ = 0.2f;
+
+	// On-demand rendering. While idle, the loop wakes up at least this often
+	// (more often if a report is due, or captures are waiting to be read
+	// back).
+	constexpr double kIdleTimeout_ = 1.0;
+	constexpr double kCapturePollInterval_ = 0.01;
+
+	// Occlusion culling. The terrain is drawn in kSceneChunkGrid_^2 chunks,
+	// and stands in as an occluder for itself (and the rocket) at a coarser
+	// resolution of kOccluderGrid_^2 cells.
+	constexpr std::size_t kSceneChunkGrid_ = 16;
+	constexpr std::size_t kOccluderGrid_ = 64;
+
+	// Used for the terrain if its MTL file does not reference a diffuse map.
+	constexpr char const* kTerrainTexture_ = "assets/cw2/L3211E-4k.jpg";
+
+	// Rocket exhaust. The nozzle is at the rocket's origin; the plume is
+	// pushed down and slowed by drag, then rises slowly as smoke.
+	constexpr std::size_t kMaxParticles_ = std::size_t(1) << 20;
+	constexpr ParticleEmitter kExhaustEmitter_{
+		kRocketPosition_,
+		{ 0.f, -6.f, 0.f },
+		0.25f, 0.3f, 0.15f,
+		2.f, 4.f,
+		250000.f
+	};
+	constexpr ParticleForces kExhaustForces_{ { 0.f, 1.2f, 0.f }, 1.5f };
+	constexpr float kParticleSize_ = 0.04f;
+
+	constexpr char const* kUsage_ = R"(Usage: main [options]
+  --capture-frames N    capture the first N frames, then exit
+  --capture-dir PATH    where captured frames are written (default: .)
+  --capture-format F    png or raw (binary PPM) (default: png)
+  --headless            render offscreen, in a hidden window, with a fixed
+                        time step; for reproducible reference images
+  --on-demand           only render when something changed; otherwise wait
+                        for events and keep showing the last frame. Starts
+                        with the exhaust paused (see below)
+  --pause-exhaust       start with the exhaust animation paused
+  --run-exhaust         start with the exhaust animation running, also
+                        with --on-demand
+  --report-interval S   print CPU and GPU utilisation, and occlusion culling
+                        statistics, every S seconds
+  --no-occlusion        start with occlusion culling disabled
+
+Keys: F12 saves a screenshot (PNG), F10 starts/stops recording (raw),
+C toggles camera collision, P pauses/resumes the exhaust, O toggles
+occlusion culling. Left click (with the cursor visible) picks the surface
+under the cursor.
+
+With --on-demand, the running exhaust counts as animation and keeps the
+loop rendering every frame, so it starts paused; press P (or pass
+--run-exhaust) to run it, and pause it again to let the loop go idle.
+)";
+
+	struct Options_
+	{
+		bool headless = false;
+		bool onDemand = false;
+		bool pauseExhaust = false;
+		bool runExhaust = false;
+		bool occlusion = true;
+		double reportInterval = 0.;
+		std::size_t captureFrames = 0;
+		std::string captureDir = ".";
+		CaptureFormat captureFormat = CaptureFormat::png;
+	};
+
+	Options_ parse_options_(int, char*[]);
+
+	// Offscreen render target for headless mode. A hidden window's default
+	// framebuffer is not guaranteed to retain its pixels.
+	struct OffscreenTarget_
+	{
+		OffscreenTarget_(GLsizei aWidth, GLsizei aHeight);
+		~OffscreenTarget_();
+
+		GLuint fbo = 0;
+		GLuint color = 0, depth = 0;
+		GLsizei width = 0, height = 0;
+	};
+
+	// Copies the offscreen target (if any) to the back buffer, and swaps.
+	void present_(GLFWwindow*, OffscreenTarget_ const*);
+
+	// CPU-side scene data. Loaded and prepared on a background thread.
+	struct SceneAssets_
+	{
+		SimpleMeshData mesh;
+		TriangleBvh bvh; // for camera collision and picking
+		MaterialDrawStats perMaterial; // cost if drawn per material
+		double bvhSeconds = 0.;
+
+		std::vector<DrawChunk> chunks; // cover all of mesh
+		std::vector<Vec3f> occluder;
+	};
+
+	SceneAssets_ load_scene_assets_();
+
+	void print_utilization_(UtilizationReport const&);
+	void print_occlusion_(OcclusionStats const&);
+
 	void glfw_callback_error_(int, char const*);
 
 	void glfw_callback_key_(GLFWwindow*, int, int, int, int);
@@ -53,8 +170,6 @@ namespace
 
 	struct State_
 	{
-		ShaderProgram* prog;
-
 		struct CamCtrl_
 		{
 			bool cameraActive;
@@ -76,8 +191,35 @@ namespace
 
 			float lastX, lastY;
 
+			bool collision;
 
 		} camControl;
+
+		struct Pick_
+		{
+			bool requested;
+			double x, y; // cursor position, window coordinates
+		} pick;
+
+		struct Capture_
+		{
+			bool screenshot;
+			bool recording;
+			std::size_t screenshots;
+			std::size_t recordedFrames;
+		} capture;
+
+		struct Redraw_
+		{
+			bool dirty;   // input or a change to the scene; render a new frame
+			bool refresh; // window contents were damaged; present again
+			bool exhaustPaused;
+		} redraw;
+
+		struct Culling_
+		{
+			bool occlusion;
+		} culling;
 	};
 
 	void glfw_callback_error_(int, char const*);
@@ -85,38 +227,17 @@ namespace
 	void glfw_callback_key_(GLFWwindow*, int, int, int, int);
 	void glfw_callback_motion_(GLFWwindow*, double, double);
 	void glfw_cb_button_(GLFWwindow*, int, int, int);
-}
-
-GLuint load_texture_2d(const char* filepath) 
-{
-	stbi_set_flip_vertically_on_load(true);
-
-	int width, height, channels;
-	unsigned char* data = stbi_load(filepath, &width, &height, &channels, 4);
-	if (!data) {
-		throw std::runtime_error("Failed to load texture");
-	}
-
-	GLuint texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	void glfw_callback_framebuffer_size_(GLFWwindow*, int, int);
+	void glfw_callback_refresh_(GLFWwindow*);
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	stbi_image_free(data);
-	return texture;
+	void resolve_camera_collision_(TriangleBvh const&, Vec3f aFrom, State_::CamCtrl_&);
+	void pick_(TriangleBvh const&, SimpleMeshData const&, Mat44f const& aClip2World, float aNdcX, float aNdcY);
 }
 
-
-
-int main() try
+int main(int aArgc, char* aArgv[]) try
 {
+	auto const opts = parse_options_(aArgc, aArgv);
+
 	// Initialize GLFW
 	if (GLFW_TRUE != glfwInit())
 	{
@@ -143,6 +264,8 @@ int main() try
 
 	glfwWindowHint(GLFW_DEPTH_BITS, 24);
 
+	if (opts.headless)
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
 
 #	if !defined(NDEBUG)
@@ -178,13 +301,15 @@ int main() try
 	glfwSetKeyCallback(window, &glfw_callback_key_);
 	glfwSetCursorPosCallback(window, &glfw_callback_motion_);
 	glfwSetMouseButtonCallback(window, &glfw_cb_button_);
+	glfwSetFramebufferSizeCallback(window, &glfw_callback_framebuffer_size_);
+	glfwSetWindowRefreshCallback(window, &glfw_callback_refresh_);
 
 
 
 
 	// Set up drawing stuff
 	glfwMakeContextCurrent(window);
-	glfwSwapInterval(1); // V-Sync is on.
+	glfwSwapInterval(opts.headless ? 0 : 1); // V-Sync is on, unless headless.
 
 	// Initialize GLAD
 	// This will load the OpenGL API. We mustn't make any OpenGL calls before this!
@@ -217,16 +342,32 @@ int main() try
 
 	glViewport(0, 0, iwidth, iheight);
 
+	// On demand, frames are kept in an offscreen target as well, so that
+	// the last one can be presented again without re-rendering it.
+	std::unique_ptr<OffscreenTarget_> offscreen;
+	if (opts.headless || opts.onDemand)
+	{
+		offscreen = std::make_unique<OffscreenTarget_>(iwidth, iheight);
+		glBindFramebuffer(GL_FRAMEBUFFER, offscreen->fbo);
+	}
+
+	// Captures for tests must be complete; interactive recording drops
+	// frames instead of slowing down the main loop.
+	FrameCapture capture(0 == opts.captureFrames);
+	std::size_t frameIndex = 0;
+
 	// Load shader program
 	ShaderProgram prog({
 		{ GL_VERTEX_SHADER, "assets/cw2/default.vert" },
 		{ GL_FRAGMENT_SHADER, "assets/cw2/default.frag" }
-		});
+	});
 
-	state.prog = &prog;
 	state.camControl.radius = 10.f;
+	state.camControl.collision = true;
+	state.redraw.exhaustPaused = opts.pauseExhaust;
+	state.redraw.dirty = true;
+	state.culling.occlusion = opts.occlusion;
 
-	GLuint texture = load_texture_2d("assets/cw2/L3211E-4k.jpg");
 	// Other initialization & loading
 	OGL_CHECKPOINT_ALWAYS();
 
@@ -241,15 +382,57 @@ int main() try
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	OGL_CHECKPOINT_ALWAYS();
 
-	//VAO
-	auto model = load_wavefront_obj("assets/cw2/langerso.obj");
-	GLuint vaoModels = create_vao(model);
-	std::size_t vertexCounterM = model.positions.size();
+	// The scene loads on a background thread; until it is ready, the window
+	// stays responsive and shows the clear colour. The loader wakes up the
+	// main loop when it is done, in case that is waiting for events.
+	std::promise<SceneAssets_> scenePromise;
+	auto sceneFuture = scenePromise.get_future();
+	std::jthread sceneLoader([&scenePromise] {
+		try
+		{
+			scenePromise.set_value(load_scene_assets_());
+		}
+		catch (...)
+		{
+			scenePromise.set_exception(std::current_exception());
+		}
+		glfwPostEmptyEvent();
+	});
 
-	auto modelRocket = load_wavefront_obj("assets/cw2/rocket.obj");
-	GLuint vaoModelRocket = create_vao(modelRocket);
-	std::size_t vertexCounterMRocket = model.positions.size();
+	// Reference images must show the scene from the first frame on.
+	if (opts.headless)
+		sceneFuture.wait();
 
+	SceneAssets_ scene;
+	GLuint sceneVao = 0;
+	std::size_t sceneVertexCount = 0;
+	MaterialSet sceneMaterials;
+	bool sceneReady = false;
+
+	// Chunks that survive occlusion culling, for glMultiDrawArrays().
+	std::unique_ptr<OcclusionCuller> occlusion;
+	std::vector<GLint> drawFirsts;
+	std::vector<GLsizei> drawCounts;
+
+	ParticleSystem exhaust(kMaxParticles_);
+	std::printf("Particles: %zu max, emitter ring %s\n", exhaust.capacity(),
+		exhaust.persistentlyMapped() ? "persistently mapped" : "mapped per frame");
+
+
+	UtilizationMonitor utilization;
+	double nextReport = opts.reportInterval > 0. ? glfwGetTime() + opts.reportInterval : std::numeric_limits<double>::infinity();
+
+	auto const account = [&] (LoopState aState) {
+		double const now = glfwGetTime();
+		utilization.update(now, aState);
+		if (now >= nextReport)
+		{
+			print_utilization_(utilization.report());
+			if (occlusion)
+				print_occlusion_(occlusion->report());
+			nextReport = now + opts.reportInterval;
+		}
+	};
 
 	double lastTime = glfwGetTime(); // Initialize with the current time
 
@@ -257,11 +440,84 @@ int main() try
 	// Main loop
 	while (!glfwWindowShouldClose(window))
 	{
+		auto const& cam = state.camControl;
+		bool const animating = !state.redraw.exhaustPaused
+			|| cam.moveForward || cam.moveBackward || cam.moveLeft || cam.moveRight || cam.moveUp || cam.moveDown
+			|| frameIndex < opts.captureFrames || state.capture.recording;
+
+		// Let GLFW process events. On demand, block until something happens,
+		// unless there is already something to draw. Time spent waiting does
+		// not count towards the next frame's time step.
+		if (opts.onDemand && !animating && !state.redraw.dirty)
+		{
+			double timeout = capture.pending() ? kCapturePollInterval_ : kIdleTimeout_;
+			timeout = std::clamp(nextReport - glfwGetTime(), 0., timeout);
+
+			glfwWaitEventsTimeout(timeout);
+			lastTime = glfwGetTime();
+
+			// The wait was idle time, even if it ended because of input that
+			// leads to a new frame below.
+			account(LoopState::idle);
+		}
+		else
+		{
+			glfwPollEvents();
+		}
+
+		if (!sceneReady && std::future_status::ready == sceneFuture.wait_for(std::chrono::seconds(0)))
+		{
+			scene = sceneFuture.get();
+			sceneVao = create_vao(scene.mesh);
+			sceneVertexCount = scene.mesh.positions.size();
+			sceneMaterials = create_material_set(scene.mesh.materials);
+			occlusion = std::make_unique<OcclusionCuller>(std::move(scene.occluder));
+			sceneReady = true;
+			state.redraw.dirty = true;
+
+			std::printf("BVH: %zu triangles, %zu nodes, depth %zu, built in %.1f ms\n",
+				scene.bvh.triangle_count(), scene.bvh.node_count(), scene.bvh.depth(),
+				scene.bvhSeconds * 1000.0
+			);
+			std::printf("Scene: %zu materials, %zu texture layers; 1 draw call and 1 texture bind per frame (per-material: %zu draw calls, %zu texture binds)\n",
+				sceneMaterials.materialCount, sceneMaterials.layerCount,
+				scene.perMaterial.draws, scene.perMaterial.textureBinds
+			);
+			std::printf("Occlusion: %zu chunks, %zu occluder triangles, %zu workers, %s rasterizer\n",
+				scene.chunks.size(), occlusion->occluder_triangle_count(), occlusion->worker_count(),
+				occlusion->uses_avx2() ? "AVX2" : "scalar"
+			);
+		}
+
+		if (opts.onDemand && !animating && !state.redraw.dirty)
+		{
+			// Nothing changed. If the window was damaged, show the last
+			// frame again.
+			if (state.redraw.refresh)
+			{
+				utilization.begin_gpu_frame(LoopState::idle);
+				present_(window, offscreen.get());
+				utilization.end_gpu_frame();
+				state.redraw.refresh = false;
+			}
+
+			capture.poll();
+			account(LoopState::idle);
+			continue;
+		}
+
+		state.redraw.dirty = false;
+		state.redraw.refresh = false;
 
 		//move with time 
 		double currentTime = glfwGetTime();
 		float deltaTime = static_cast<float>(currentTime - lastTime);
 		lastTime = currentTime;
+
+		// Headless runs produce reference images; make them independent of
+		// how long each frame took.
+		if (opts.headless)
+			deltaTime = 1.f / 60.f;
 		//speed control
 		float currentSpeed = kMovementPerSecond_;
 		if (state.camControl.speedUp)
@@ -272,8 +528,6 @@ int main() try
 		{
 			currentSpeed *= ctrlAcc;
 		}
-		// Let GLFW process events
-		glfwPollEvents();
 
 		// Check if window was resized.
 		float fbwidth, fbheight;
@@ -296,8 +550,16 @@ int main() try
 			}
 
 			glViewport(0, 0, nwidth, nheight);
+
+			if (offscreen && (offscreen->width != nwidth || offscreen->height != nheight))
+			{
+				offscreen = std::make_unique<OffscreenTarget_>(nwidth, nheight);
+				glBindFramebuffer(GL_FRAMEBUFFER, offscreen->fbo);
+			}
 		}
 
+		Vec3f const prevCameraPos{ state.camControl.posX, state.camControl.posY, state.camControl.posZ };
+
 		// ws moving
 
 		float forwardX = std::sin(state.camControl.phi) * std::cos(state.camControl.theta);
@@ -347,6 +609,8 @@ int main() try
 			state.camControl.posY -= kMovementPerSecond_ * deltaTime * currentSpeed;
 		}
 
+		if (state.camControl.collision && sceneReady)
+			resolve_camera_collision_(scene.bvh, prevCameraPos, state.camControl);
 
 
 
@@ -369,20 +633,41 @@ int main() try
 			0.1f, 100.0f
 		);
 		Mat44f model2world = make_translation({ 0,0,0 });
+
+		// Occluders are rasterized on worker threads while this thread goes
+		// on to issue GL commands (the GPU may still be busy with the previous
+		// frame); the result is needed only for the scene draw.
+		bool const cullScene = sceneReady && state.culling.occlusion;
+		if (cullScene)
+			occlusion->begin(projection * world2camera);
+
+		if (state.pick.requested && sceneReady)
+		{
+			int wwidth, wheight;
+			glfwGetWindowSize(window, &wwidth, &wheight);
+
+			float const ndcX = float(2.0 * state.pick.x / wwidth - 1.0);
+			float const ndcY = float(1.0 - 2.0 * state.pick.y / wheight);
+			pick_(scene.bvh, scene.mesh, invert(projection * world2camera), ndcX, ndcY);
+
+			state.pick.requested = false;
+		}
 		// Draw scene
 		OGL_CHECKPOINT_DEBUG();
 
 		//TODO: draw frame
+		utilization.begin_gpu_frame(LoopState::active);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		// Exhaust simulation. Clamp the time step, so that a long stall does
+		// not spawn a huge burst.
+		if (!state.redraw.exhaustPaused)
+			exhaust.update(std::min(deltaTime, 0.1f), { &kExhaustEmitter_, 1 }, kExhaustForces_);
+
 		Mat44f projCameraWorld = projection * world2camera * model2world;
 		// Bind shader program
 		glUseProgram(prog.programId());
 
-		//glActiveTexture(GL_TEXTURE0);
-		//glBindTexture(GL_TEXTURE_2D, texture);
-		glUniform1i(glGetUniformLocation(prog.programId(), "uTexture"), 0);
-
-
 
 		// Light direction (normalized)
 		Vec3f lightDir = normalize(Vec3f{ 0.f, 1.f, -1.f });
@@ -396,45 +681,83 @@ int main() try
 
 
 
-		GLint projCameraWorldLoc = glGetUniformLocation(prog.programId(), "uProjCameraWorld");
-		//glUniformMatrix4fv(projCameraWorldLoc, 1, GL_TRUE, projCameraWorld.v);
+		glUniformMatrix4fv(0, 1, GL_TRUE, projCameraWorld.v); // uProjCameraWorld
 
 		Mat33f normalMatrix = mat44_to_mat33(transpose(invert(model2world)));
-		GLint uNormalMatrixLoc = glGetUniformLocation(prog.programId(), "uNormalMatrix");
-		glUniformMatrix3fv(uNormalMatrixLoc // uNormalMatrixLoc = 1
-			, 1, GL_TRUE, normalMatrix.v);
-
-		// land draw
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		//lUniform1i(glGetUniformLocation(prog.programId(), "uTexture"), 0);
-		glUniform1i(glGetUniformLocation(prog.programId(), "useTexture"), GL_TRUE); 
-		Mat44f langersoModel2World = make_translation({ 0, 0, 0 });
-		Mat44f projCameraWorldLangerso = projection * world2camera * langersoModel2World;
-		glUniformMatrix4fv(projCameraWorldLoc, 1, GL_TRUE, projCameraWorldLangerso.v);
-
-		glBindVertexArray(vaoModels);
-		glDrawArrays(GL_TRIANGLES, 0, vertexCounterM);
-		glBindVertexArray(0);
-
-		//rocket draw 
-		Mat44f rocketModel2World = make_translation({ 0.0f, 5.0f, -10.0f }) ;
-		Mat44f projCameraWorldRocket = projection * world2camera * rocketModel2World;
-		glUniformMatrix4fv(projCameraWorldLoc, 1, GL_TRUE, projCameraWorldRocket.v);		
-		//no texture
-		glUniform1i(glGetUniformLocation(prog.programId(), "useTexture"), GL_FALSE); // 
-		glBindVertexArray(vaoModelRocket);
-		glDrawArrays(GL_TRIANGLES, 0, vertexCounterMRocket);
-		glBindVertexArray(0);
+		glUniformMatrix3fv(1, 1, GL_TRUE, normalMatrix.v); // uNormalMatrix
+
+		// scene draw; terrain and rocket, all materials in one call
+		if (sceneReady)
+		{
+			bind_material_set(sceneMaterials);
+			glBindVertexArray(sceneVao);
+			if (cullScene)
+			{
+				occlusion->cull(scene.chunks, drawFirsts, drawCounts);
+				glMultiDrawArrays(GL_TRIANGLES, drawFirsts.data(), drawCounts.data(), GLsizei(drawFirsts.size()));
+			}
+			else
+			{
+				glDrawArrays(GL_TRIANGLES, 0, GLsizei(sceneVertexCount));
+			}
+			glBindVertexArray(0);
+		}
+
+		// Exhaust; drawn after the opaque geometry.
+		exhaust.draw(projection * world2camera, world2camera, kParticleSize_);
+
+		utilization.end_gpu_frame();
 
 
 		OGL_CHECKPOINT_DEBUG();
 
+		// Capture; before swapping, while the frame is in the back buffer.
+		{
+			char path[512];
+			if (frameIndex < opts.captureFrames)
+			{
+				char const* ext = CaptureFormat::png == opts.captureFormat ? "png" : "ppm";
+				std::snprintf(path, sizeof(path), "%s/frame-%04zu.%s", opts.captureDir.c_str(), frameIndex, ext);
+				capture.capture(GLsizei(fbwidth), GLsizei(fbheight), path, opts.captureFormat);
+			}
+			if (state.capture.screenshot)
+			{
+				std::snprintf(path, sizeof(path), "%s/screenshot-%03zu.png", opts.captureDir.c_str(), state.capture.screenshots++);
+				capture.capture(GLsizei(fbwidth), GLsizei(fbheight), path, CaptureFormat::png);
+				state.capture.screenshot = false;
+			}
+			if (state.capture.recording)
+			{
+				std::snprintf(path, sizeof(path), "%s/rec-%06zu.ppm", opts.captureDir.c_str(), state.capture.recordedFrames++);
+				capture.capture(GLsizei(fbwidth), GLsizei(fbheight), path, CaptureFormat::raw);
+			}
+
+			capture.poll();
+		}
+
 		// Display results
-		glfwSwapBuffers(window);
+		if (!opts.headless)
+			present_(window, offscreen.get());
+
+		account(LoopState::active);
+
+		if (++frameIndex == opts.captureFrames)
+			break;
 	}
 
 	// Cleanup.
+	capture.flush();
+	if (auto const stats = capture.stats(); stats.requested)
+		std::printf("Capture: %zu frames written, %zu dropped, %zu failed\n", stats.written, stats.dropped, stats.failed);
+
+	if (opts.reportInterval > 0.)
+	{
+		print_utilization_(utilization.report());
+		if (occlusion)
+			print_occlusion_(occlusion->report());
+	}
+
+	delete_material_set(sceneMaterials);
 	//TODO: additional cleanup
 
 	return 0;
@@ -465,6 +788,8 @@ namespace
 
 		if (auto* state = static_cast<State_*>(glfwGetWindowUserPointer(aWindow)))
 		{
+			state->redraw.dirty = true;
+
 			//Moving
 			if (GLFW_KEY_W == aKey)
 			{
@@ -525,6 +850,34 @@ namespace
 				else if (aAction == GLFW_RELEASE)
 					state->camControl.speedUp = false;
 			}
+			//Capture
+			if (GLFW_KEY_F12 == aKey && aAction == GLFW_PRESS)
+			{
+				state->capture.screenshot = true;
+			}
+			if (GLFW_KEY_F10 == aKey && aAction == GLFW_PRESS)
+			{
+				state->capture.recording = !state->capture.recording;
+				std::printf("Recording %s\n", state->capture.recording ? "started" : "stopped");
+			}
+			//Collision
+			if (GLFW_KEY_C == aKey && aAction == GLFW_PRESS)
+			{
+				state->camControl.collision = !state->camControl.collision;
+				std::printf("Camera collision %s\n", state->camControl.collision ? "on" : "off");
+			}
+			//Animation
+			if (GLFW_KEY_P == aKey && aAction == GLFW_PRESS)
+			{
+				state->redraw.exhaustPaused = !state->redraw.exhaustPaused;
+				std::printf("Exhaust %s\n", state->redraw.exhaustPaused ? "paused" : "running");
+			}
+			//Culling
+			if (GLFW_KEY_O == aKey && aAction == GLFW_PRESS)
+			{
+				state->culling.occlusion = !state->culling.occlusion;
+				std::printf("Occlusion culling %s\n", state->culling.occlusion ? "on" : "off");
+			}
 
 
 		}
@@ -536,6 +889,7 @@ namespace
 		{
 			if (state->camControl.cameraActive)
 			{
+				state->redraw.dirty = true;
 
 				int width, height;
 				glfwGetWindowSize(aWindow, &width, &height);
@@ -575,6 +929,8 @@ namespace
 	{
 		if (auto* state = static_cast<State_*>(glfwGetWindowUserPointer(aWindow)))
 		{
+			state->redraw.dirty = true;
+
 			if (aAction == GLFW_PRESS && aButton == GLFW_MOUSE_BUTTON_RIGHT) {
 				state->camControl.cameraActive = !state->camControl.cameraActive;
 
@@ -594,14 +950,264 @@ namespace
 					glfwSetInputMode(aWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 				}
 			}
+
+			if (aAction == GLFW_PRESS && aButton == GLFW_MOUSE_BUTTON_LEFT && !state->camControl.cameraActive)
+			{
+				glfwGetCursorPos(aWindow, &state->pick.x, &state->pick.y);
+				state->pick.requested = true;
+			}
 		}
 	}
 
+	void glfw_callback_framebuffer_size_(GLFWwindow* aWindow, int, int)
+	{
+		if (auto* state = static_cast<State_*>(glfwGetWindowUserPointer(aWindow)))
+			state->redraw.dirty = true;
+	}
+
+	void glfw_callback_refresh_(GLFWwindow* aWindow)
+	{
+		if (auto* state = static_cast<State_*>(glfwGetWindowUserPointer(aWindow)))
+			state->redraw.refresh = true;
+	}
+
 
 }
 
 namespace
 {
+	void resolve_camera_collision_(TriangleBvh const& aBvh, Vec3f aFrom, State_::CamCtrl_& aCam)
+	{
+		Vec3f to{ aCam.posX, aCam.posY, aCam.posZ };
+
+		// Stop short of any surface crossed while moving.
+		auto const delta = to - aFrom;
+		if (float const dist = length(delta); dist > 0.f)
+		{
+			Ray const ray{ aFrom, delta / dist, dist + kCameraClearance_ };
+			if (auto const hit = aBvh.intersect(ray))
+				to = aFrom + ray.direction * std::max(0.f, hit.t - kCameraClearance_);
+		}
+
+		// Keep the eye above the ground.
+		Ray const down{ to, { 0.f, -1.f, 0.f }, kCameraEyeHeight_ };
+		if (auto const hit = aBvh.intersect(down))
+			to.y += kCameraEyeHeight_ - hit.t;
+
+		aCam.posX = to.x;
+		aCam.posY = to.y;
+		aCam.posZ = to.z;
+	}
+
+	void pick_(TriangleBvh const& aBvh, SimpleMeshData const& aMesh, Mat44f const& aClip2World, float aNdcX, float aNdcY)
+	{
+		auto const unproject = [&] (float aZ) {
+			auto const p = aClip2World * Vec4f{ aNdcX, aNdcY, aZ, 1.f };
+			return Vec3f{ p.x, p.y, p.z } / p.w;
+		};
+
+		// From the near plane towards the far plane; t is in units of the
+		// (unnormalized) direction.
+		auto const nearPos = unproject(-1.f);
+		Ray const ray{ nearPos, unproject(1.f) - nearPos };
+
+		auto const hit = aBvh.intersect(ray);
+		if (!hit)
+		{
+			std::printf("Pick: nothing\n");
+			return;
+		}
+
+		auto const pos = ray.origin + ray.direction * hit.t;
+
+		char const* material = "(none)";
+		if (std::size_t(hit.triangle) * 3 < aMesh.materialIds.size())
+		{
+			auto const id = aMesh.materialIds[std::size_t(hit.triangle) * 3];
+			if (id < aMesh.materials.size())
+				material = aMesh.materials[id].name.c_str();
+		}
+
+		std::printf("Pick: triangle %u, material '%s', at (%.3f, %.3f, %.3f), %.3f from the near plane\n",
+			hit.triangle, material, pos.x, pos.y, pos.z, length(ray.direction) * hit.t
+		);
+	}
+
+	Options_ parse_options_(int aArgc, char* aArgv[])
+	{
+		Options_ ret;
+
+		for (int i = 1; i < aArgc; ++i)
+		{
+			auto const value = [&] () -> char const* {
+				if (i + 1 >= aArgc)
+					throw Error("Option '%s' requires a value\n%s", aArgv[i], kUsage_);
+				return aArgv[++i];
+			};
+
+			if (0 == std::strcmp(aArgv[i], "--capture-frames"))
+				ret.captureFrames = std::strtoull(value(), nullptr, 10);
+			else if (0 == std::strcmp(aArgv[i], "--capture-dir"))
+				ret.captureDir = value();
+			else if (0 == std::strcmp(aArgv[i], "--capture-format"))
+			{
+				char const* format = value();
+				if (0 == std::strcmp(format, "png"))
+					ret.captureFormat = CaptureFormat::png;
+				else if (0 == std::strcmp(format, "raw"))
+					ret.captureFormat = CaptureFormat::raw;
+				else
+					throw Error("Unknown capture format '%s'\n%s", format, kUsage_);
+			}
+			else if (0 == std::strcmp(aArgv[i], "--headless"))
+				ret.headless = true;
+			else if (0 == std::strcmp(aArgv[i], "--on-demand"))
+				ret.onDemand = true;
+			else if (0 == std::strcmp(aArgv[i], "--pause-exhaust"))
+			{
+				ret.pauseExhaust = true;
+				ret.runExhaust = false;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--run-exhaust"))
+			{
+				ret.pauseExhaust = false;
+				ret.runExhaust = true;
+			}
+			else if (0 == std::strcmp(aArgv[i], "--report-interval"))
+				ret.reportInterval = std::strtod(value(), nullptr);
+			else if (0 == std::strcmp(aArgv[i], "--no-occlusion"))
+				ret.occlusion = false;
+			else
+				throw Error("Unknown option '%s'\n%s", aArgv[i], kUsage_);
+		}
+
+		// Headless runs render every frame with a fixed time step.
+		if (ret.headless)
+			ret.onDemand = false;
+
+		// On demand, a running exhaust would keep the loop from ever going
+		// idle; unless asked for, start with it paused.
+		if (ret.onDemand && !ret.runExhaust)
+			ret.pauseExhaust = true;
+
+		return ret;
+	}
+
+	SceneAssets_ load_scene_assets_()
+	{
+		auto model = load_wavefront_obj("assets/cw2/langerso.obj");
+		if (std::none_of(model.materials.begin(), model.materials.end(), [] (SimpleMaterial const& aMat) { return !aMat.diffuseTexture.empty(); }))
+		{
+			// The texture stands in for the diffuse colour; don't tint it.
+			for (auto& mat : model.materials)
+			{
+				mat.diffuse = { 1.f, 1.f, 1.f };
+				mat.diffuseTexture = kTerrainTexture_;
+			}
+			std::fill(model.colors.begin(), model.colors.end(), Vec3f{ 1.f, 1.f, 1.f });
+		}
+
+		auto modelRocket = load_wavefront_obj("assets/cw2/rocket.obj");
+
+		// Both objects are static. Baking the rocket's transform into its
+		// vertices lets the whole scene, with all of its materials and
+		// textures, render with a single VAO, texture bind and draw call.
+		auto const perMaterialTerrain = per_material_draw_stats(model);
+		auto const perMaterialRocket = per_material_draw_stats(modelRocket);
+
+		SceneAssets_ ret;
+
+		// Draw chunks for occlusion culling. Sorting the terrain's triangles
+		// into chunks reorders its vertices, so this must happen before
+		// anything else refers to them. The rocket is a single chunk.
+		ret.chunks = make_draw_chunks(model, kSceneChunkGrid_);
+		ret.occluder = make_heightfield_occluder(model, kOccluderGrid_);
+
+		auto rocket = transform(std::move(modelRocket), make_translation(kRocketPosition_));
+		auto const rocketChunks = make_draw_chunks(rocket, 1, GLint(model.positions.size()));
+		ret.chunks.insert(ret.chunks.end(), rocketChunks.begin(), rocketChunks.end());
+
+		ret.mesh = concatenate(std::move(model), rocket);
+		ret.perMaterial.draws = perMaterialTerrain.draws + perMaterialRocket.draws;
+		ret.perMaterial.textureBinds = perMaterialTerrain.textureBinds + perMaterialRocket.textureBinds;
+
+		double const bvhStart = glfwGetTime();
+		ret.bvh = TriangleBvh(ret.mesh);
+		ret.bvhSeconds = glfwGetTime() - bvhStart;
+
+		return ret;
+	}
+
+	void present_(GLFWwindow* aWindow, OffscreenTarget_ const* aTarget)
+	{
+		if (aTarget)
+		{
+			// Plain copy; the target already holds sRGB-encoded values.
+			glDisable(GL_FRAMEBUFFER_SRGB);
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, aTarget->fbo);
+			glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+			glBlitFramebuffer(0, 0, aTarget->width, aTarget->height, 0, 0, aTarget->width, aTarget->height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			glBindFramebuffer(GL_FRAMEBUFFER, aTarget->fbo);
+			glEnable(GL_FRAMEBUFFER_SRGB);
+		}
+
+		glfwSwapBuffers(aWindow);
+	}
+
+	void print_utilization_(UtilizationReport const& aReport)
+	{
+		std::printf("Utilisation: active %.1f s, %zu frames, CPU %.1f%%, GPU %.1f%%; idle %.1f s, CPU %.1f%%, GPU %.1f%%\n",
+			aReport.active.seconds, aReport.active.frames, aReport.active.cpu_percent(), aReport.active.gpu_percent(),
+			aReport.idle.seconds, aReport.idle.cpu_percent(), aReport.idle.gpu_percent()
+		);
+	}
+
+	void print_occlusion_(OcclusionStats const& aStats)
+	{
+		if (0 == aStats.frames)
+			return;
+
+		double const frames = double(aStats.frames);
+		std::printf("Occlusion: %zu frames, %.1f of %.1f chunks culled per frame (%.1f occluded, %.1f outside), %.0f of %.0f triangles; culling %.3f ms, rasterizing %.3f ms per frame\n",
+			aStats.frames,
+			(aStats.occluded + aStats.outside) / frames, aStats.candidates / frames,
+			aStats.occluded / frames, aStats.outside / frames,
+			aStats.occludedTriangles / frames, aStats.triangles / frames,
+			aStats.cullSeconds * 1000.0 / frames, aStats.rasterSeconds * 1000.0 / frames
+		);
+	}
+
+	OffscreenTarget_::OffscreenTarget_(GLsizei aWidth, GLsizei aHeight)
+		: width(aWidth)
+		, height(aHeight)
+	{
+		glGenRenderbuffers(1, &color);
+		glBindRenderbuffer(GL_RENDERBUFFER, color);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_SRGB8_ALPHA8, aWidth, aHeight);
+
+		glGenRenderbuffers(1, &depth);
+		glBindRenderbuffer(GL_RENDERBUFFER, depth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, aWidth, aHeight);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+		if (GL_FRAMEBUFFER_COMPLETE != glCheckFramebufferStatus(GL_FRAMEBUFFER))
+			throw Error("Offscreen framebuffer is incomplete");
+
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	OffscreenTarget_::~OffscreenTarget_()
+	{
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteRenderbuffers(1, &depth);
+		glDeleteRenderbuffers(1, &color);
+	}
+
 	GLFWCleanupHelper::~GLFWCleanupHelper()
 	{
 		glfwTerminate();
@@ -0,0 +1,86 @@
+#include "material.hpp"
+
+#include <string>
+#include <unordered_map>
+
+#include "texture.hpp"
+
+MaterialSet create_material_set(std::vector<SimpleMaterial> const& aMaterials)
+{
+	MaterialSet ret;
+	ret.materialCount = aMaterials.size();
+
+	// One layer per distinct texture; materials may share textures.
+	std::vector<std::string> paths;
+	std::unordered_map<std::string, GLint> layerOfPath;
+	std::vector<GLint> layers;
+	for (auto const& mat : aMaterials)
+	{
+		if (mat.diffuseTexture.empty())
+		{
+			layers.emplace_back(-1);
+			continue;
+		}
+
+		auto const [it, inserted] = layerOfPath.emplace(mat.diffuseTexture, GLint(paths.size()));
+		if (inserted)
+			paths.emplace_back(mat.diffuseTexture);
+		layers.emplace_back(it->second);
+	}
+
+	ret.layerCount = paths.size();
+	if (!paths.empty())
+		ret.textures = load_texture_2d_array(paths);
+
+	// An empty SSBO cannot be bound; keep at least one entry.
+	if (layers.empty())
+		layers.emplace_back(-1);
+
+	glGenBuffers(1, &ret.layerTable);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ret.layerTable);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(layers.size() * sizeof(GLint)), layers.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	return ret;
+}
+
+void delete_material_set(MaterialSet& aSet)
+{
+	glDeleteBuffers(1, &aSet.layerTable);
+	glDeleteTextures(1, &aSet.textures);
+	aSet = MaterialSet{};
+}
+
+void bind_material_set(MaterialSet const& aSet)
+{
+	glActiveTexture(GL_TEXTURE0 + kMaterialTextureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, aSet.textures);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kMaterialTableBinding, aSet.layerTable);
+}
+
+MaterialDrawStats per_material_draw_stats(SimpleMeshData const& aMesh)
+{
+	MaterialDrawStats ret;
+
+	if (aMesh.materialIds.empty())
+	{
+		ret.draws = aMesh.positions.empty() ? 0 : 1;
+		return ret;
+	}
+
+	std::vector<bool> used(aMesh.materials.size(), false);
+	for (auto const id : aMesh.materialIds)
+		used[id] = true;
+
+	for (std::size_t i = 0; i < used.size(); ++i)
+	{
+		if (!used[i])
+			continue;
+
+		++ret.draws;
+		if (!aMesh.materials[i].diffuseTexture.empty())
+			++ret.textureBinds;
+	}
+
+	return ret;
+}
@@ -0,0 +1,57 @@
+#ifndef MATERIAL_HPP_2D86FD19_E2E6_40CF_B8D0_0F1982EBACD0
+#define MATERIAL_HPP_2D86FD19_E2E6_40CF_B8D0_0F1982EBACD0
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include <cstddef>
+
+#include "simple_mesh.hpp"
+
+/* GPU side of the mesh materials.
+ *
+ * All diffuse textures of a material list go into the layers of one
+ * GL_TEXTURE_2D_ARRAY. A small SSBO maps each material ID to its texture
+ * layer (-1 if untextured). The vertex colour holds the diffuse colour (Kd);
+ * the texture (map_Kd), if any, is multiplied with it. With the material ID
+ * as a vertex attribute (see create_vao()), a mesh with any number of
+ * materials and textures draws in a single call with a single texture bind.
+ */
+
+struct MaterialSet
+{
+	GLuint textures = 0;        // GL_TEXTURE_2D_ARRAY, or 0 if no textures
+	GLuint layerTable = 0;      // SSBO, one int per material
+	std::size_t materialCount = 0;
+	std::size_t layerCount = 0;
+};
+
+// Binding points used by the material program.
+inline constexpr GLuint kMaterialTextureUnit = 0;
+inline constexpr GLuint kMaterialTableBinding = 5;
+
+MaterialSet create_material_set(std::vector<SimpleMaterial> const&);
+void delete_material_set(MaterialSet&);
+
+void bind_material_set(MaterialSet const&);
+
+// The program for meshes created with create_vao() is assets/cw2/default.vert
+// and default.frag. Uniforms:
+//   location 0: mat4 uProjCameraWorld
+//   location 1: mat3 uNormalMatrix
+//   location 2: vec3 uLightDir (normalized, towards the light)
+//   location 3: vec3 uLightDiffuse
+//   location 4: vec3 uSceneAmbient
+
+// Draw calls and texture binds that drawing the mesh would take with one
+// texture per draw (one draw per distinct material used).
+struct MaterialDrawStats
+{
+	std::size_t draws = 0;
+	std::size_t textureBinds = 0;
+};
+
+MaterialDrawStats per_material_draw_stats(SimpleMeshData const&);
+
+#endif // MATERIAL_HPP_2D86FD19_E2E6_40CF_B8D0_0F1982EBACD0
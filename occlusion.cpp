@@ -0,0 +1,725 @@
+#include "occlusion.hpp"
+
+#include <limits>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+#include <cmath>
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#	include <intrin.h>
+#endif
+
+#include "../support/error.hpp"
+
+// MSVC allows AVX2 intrinsics anywhere; GCC and Clang need the functions
+// that use them to be compiled for AVX2.
+#if defined(_MSC_VER)
+#	define OCCLUSION_TARGET_AVX2_
+#else
+#	define OCCLUSION_TARGET_AVX2_ __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	constexpr int kTileW_ = 8;
+	constexpr int kTileH_ = 4;
+	constexpr int kTileSize_ = kTileW_ * kTileH_;
+
+	// Occluders are clipped against w = kNearW_; boxes that reach closer than
+	// that are always visible.
+	constexpr float kNearW_ = 0.01f;
+
+	constexpr float kInf_ = std::numeric_limits<float>::infinity();
+
+	bool cpu_supports_avx2_() noexcept
+	{
+#		if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// AVX2 also needs the OS to save the YMM registers (OSXSAVE + XCR0).
+		__cpuid(info, 1);
+		if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)))
+			return false;
+		if (6 != (_xgetbv(0) & 6))
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return 0 != (info[1] & (1 << 5));
+#		elif defined(__GNUC__)
+		return __builtin_cpu_supports("avx2");
+#		else
+		return false;
+#		endif
+	}
+
+	struct ClipVertex_
+	{
+		float x, y, w;
+	};
+
+	ClipVertex_ lerp_(ClipVertex_ const& aA, ClipVertex_ const& aB, float aT) noexcept
+	{
+		return { aA.x + (aB.x - aA.x) * aT, aA.y + (aB.y - aA.y) * aT, aA.w + (aB.w - aA.w) * aT };
+	}
+
+	// Clips a triangle against w >= kNearW_. Returns the number of vertices
+	// (0, 3 or 4) of the resulting convex polygon; the winding is kept.
+	int clip_near_(ClipVertex_ const (&aIn)[3], ClipVertex_ (&aOut)[4]) noexcept
+	{
+		int count = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			auto const& a = aIn[i];
+			auto const& b = aIn[(i + 1) % 3];
+
+			bool const aInside = a.w >= kNearW_;
+			bool const bInside = b.w >= kNearW_;
+
+			if (aInside)
+				aOut[count++] = a;
+			if (aInside != bInside)
+				aOut[count++] = lerp_(a, b, (kNearW_ - a.w) / (b.w - a.w));
+		}
+		return count;
+	}
+
+	// Lowest tile row of any pixel in [aY0, aY1), and one past the highest.
+	inline int tile_row_begin_(int aY0) noexcept { return aY0 / kTileH_; }
+	inline int tile_row_end_(int aY1) noexcept { return (aY1 + kTileH_ - 1) / kTileH_; }
+}
+
+std::vector<DrawChunk> make_draw_chunks(SimpleMeshData& aMesh, std::size_t aGrid, GLint aFirstVertex)
+{
+	auto const vertexCount = aMesh.positions.size();
+	if (0 != vertexCount % 3)
+		throw Error("make_draw_chunks(): vertex count (%zu) is not a multiple of three", vertexCount);
+
+	auto const triangleCount = vertexCount / 3;
+	if (0 == triangleCount || 0 == aGrid)
+		return {};
+
+	auto const centroid = [&] (std::size_t aTriangle) {
+		auto const* p = aMesh.positions.data() + aTriangle * 3;
+		return (p[0] + p[1] + p[2]) * (1.f / 3.f);
+	};
+
+	float loX = kInf_, loZ = kInf_, hiX = -kInf_, hiZ = -kInf_;
+	for (std::size_t i = 0; i < triangleCount; ++i)
+	{
+		auto const c = centroid(i);
+		loX = std::min(loX, c.x); hiX = std::max(hiX, c.x);
+		loZ = std::min(loZ, c.z); hiZ = std::max(hiZ, c.z);
+	}
+
+	float const scaleX = hiX > loX ? float(aGrid) / (hiX - loX) : 0.f;
+	float const scaleZ = hiZ > loZ ? float(aGrid) / (hiZ - loZ) : 0.f;
+
+	std::vector<std::uint32_t> cells(triangleCount);
+	std::vector<std::size_t> offsets(aGrid * aGrid + 1, 0);
+	for (std::size_t i = 0; i < triangleCount; ++i)
+	{
+		auto const c = centroid(i);
+		auto const cx = std::min(aGrid - 1, std::size_t((c.x - loX) * scaleX));
+		auto const cz = std::min(aGrid - 1, std::size_t((c.z - loZ) * scaleZ));
+
+		cells[i] = std::uint32_t(cz * aGrid + cx);
+		++offsets[cells[i] + 1];
+	}
+
+	for (std::size_t i = 1; i < offsets.size(); ++i)
+		offsets[i] += offsets[i - 1];
+
+	// Counting sort; stable, so triangles keep their relative order (and
+	// thus, roughly, their locality) within a cell.
+	std::vector<std::uint32_t> order(triangleCount);
+	{
+		auto cursor = offsets;
+		for (std::size_t i = 0; i < triangleCount; ++i)
+			order[cursor[cells[i]]++] = std::uint32_t(i);
+	}
+
+	auto const permute = [&] (auto& aVertexData) {
+		if (aVertexData.size() != vertexCount)
+			return;
+
+		std::remove_reference_t<decltype(aVertexData)> sorted;
+		sorted.reserve(vertexCount);
+		for (auto const tri : order)
+		{
+			auto const from = aVertexData.begin() + std::ptrdiff_t(tri) * 3;
+			sorted.insert(sorted.end(), from, from + 3);
+		}
+		aVertexData = std::move(sorted);
+	};
+
+	permute(aMesh.positions);
+	permute(aMesh.colors);
+	permute(aMesh.normals);
+	permute(aMesh.texcoords);
+	permute(aMesh.materialIds);
+
+	std::vector<DrawChunk> ret;
+	for (std::size_t cell = 0; cell + 1 < offsets.size(); ++cell)
+	{
+		if (offsets[cell] == offsets[cell + 1])
+			continue;
+
+		DrawChunk chunk{};
+		chunk.first = aFirstVertex + GLint(offsets[cell] * 3);
+		chunk.count = GLsizei((offsets[cell + 1] - offsets[cell]) * 3);
+		chunk.boundsMin = { kInf_, kInf_, kInf_ };
+		chunk.boundsMax = { -kInf_, -kInf_, -kInf_ };
+
+		for (std::size_t v = offsets[cell] * 3; v < offsets[cell + 1] * 3; ++v)
+		{
+			auto const& p = aMesh.positions[v];
+			chunk.boundsMin = { std::min(chunk.boundsMin.x, p.x), std::min(chunk.boundsMin.y, p.y), std::min(chunk.boundsMin.z, p.z) };
+			chunk.boundsMax = { std::max(chunk.boundsMax.x, p.x), std::max(chunk.boundsMax.y, p.y), std::max(chunk.boundsMax.z, p.z) };
+		}
+
+		ret.emplace_back(chunk);
+	}
+
+	return ret;
+}
+
+std::vector<Vec3f> make_heightfield_occluder(SimpleMeshData const& aTerrain, std::size_t aGrid)
+{
+	// Needs at least one cell inside the outermost ring.
+	if (aGrid < 3 || aTerrain.positions.size() < 3)
+		return {};
+
+	float loX = kInf_, loZ = kInf_, hiX = -kInf_, hiZ = -kInf_;
+	for (auto const& p : aTerrain.positions)
+	{
+		loX = std::min(loX, p.x); hiX = std::max(hiX, p.x);
+		loZ = std::min(loZ, p.z); hiZ = std::max(hiZ, p.z);
+	}
+
+	if (!(hiX > loX) || !(hiZ > loZ))
+		return {};
+
+	float const cellX = (hiX - loX) / float(aGrid);
+	float const cellZ = (hiZ - loZ) / float(aGrid);
+
+	auto const cell_index = [&] (float aValue, float aLo, float aSize) {
+		auto const i = std::floor((aValue - aLo) / aSize);
+		return std::size_t(std::clamp(i, 0.f, float(aGrid - 1)));
+	};
+
+	// Lowest point of any triangle that overlaps a cell. Using the whole
+	// triangle's minimum may be lower than the surface in the cell, which is
+	// fine: the occluder must not stick out of the terrain, but may sink.
+	std::vector<float> cellMin(aGrid * aGrid, kInf_);
+	for (std::size_t i = 0; i + 2 < aTerrain.positions.size(); i += 3)
+	{
+		auto const& a = aTerrain.positions[i];
+		auto const& b = aTerrain.positions[i + 1];
+		auto const& c = aTerrain.positions[i + 2];
+
+		auto const x0 = cell_index(std::min({ a.x, b.x, c.x }), loX, cellX);
+		auto const x1 = cell_index(std::max({ a.x, b.x, c.x }), loX, cellX);
+		auto const z0 = cell_index(std::min({ a.z, b.z, c.z }), loZ, cellZ);
+		auto const z1 = cell_index(std::max({ a.z, b.z, c.z }), loZ, cellZ);
+		auto const y = std::min({ a.y, b.y, c.y });
+
+		for (auto z = z0; z <= z1; ++z)
+		{
+			for (auto x = x0; x <= x1; ++x)
+				cellMin[z * aGrid + x] = std::min(cellMin[z * aGrid + x], y);
+		}
+	}
+
+	// Grid vertex (x, z) is shared by cells (x-1..x, z-1..z).
+	auto const height = [&] (std::size_t aX, std::size_t aZ) {
+		float h = kInf_;
+		for (auto z = aZ - 1; z <= aZ; ++z)
+		{
+			for (auto x = aX - 1; x <= aX; ++x)
+				h = std::min(h, cellMin[z * aGrid + x]);
+		}
+		return h;
+	};
+
+	std::vector<float> heights((aGrid + 1) * (aGrid + 1), kInf_);
+	for (std::size_t z = 1; z < aGrid; ++z)
+	{
+		for (std::size_t x = 1; x < aGrid; ++x)
+			heights[z * (aGrid + 1) + x] = height(x, z);
+	}
+
+	std::vector<Vec3f> ret;
+	ret.reserve((aGrid - 2) * (aGrid - 2) * 6);
+	for (std::size_t z = 1; z + 1 < aGrid; ++z)
+	{
+		for (std::size_t x = 1; x + 1 < aGrid; ++x)
+		{
+			auto const vertex = [&] (std::size_t aX, std::size_t aZ) {
+				return Vec3f{ loX + float(aX) * cellX, heights[aZ * (aGrid + 1) + aX], loZ + float(aZ) * cellZ };
+			};
+
+			auto const v00 = vertex(x, z), v10 = vertex(x + 1, z);
+			auto const v01 = vertex(x, z + 1), v11 = vertex(x + 1, z + 1);
+
+			// Cells without any terrain (holes) do not occlude.
+			if (!std::isfinite(v00.y) || !std::isfinite(v10.y) || !std::isfinite(v01.y) || !std::isfinite(v11.y))
+				continue;
+
+			// Counter-clockwise when seen from above (+y).
+			ret.insert(ret.end(), { v00, v01, v11 });
+			ret.insert(ret.end(), { v00, v11, v10 });
+		}
+	}
+
+	return ret;
+}
+
+OcclusionCuller::OcclusionCuller(std::vector<Vec3f> aOccluderTriangles, OcclusionOptions const& aOptions)
+	: mOccluders(std::move(aOccluderTriangles))
+	, mWidth(aOptions.width)
+	, mHeight(aOptions.height)
+	, mTilesX((aOptions.width + kTileW_ - 1) / kTileW_)
+	, mTilesY((aOptions.height + kTileH_ - 1) / kTileH_)
+	, mAvx2(aOptions.allowAvx2 && cpu_supports_avx2_())
+	, mProjCameraWorld(kIdentity44f)
+{
+	if (mWidth <= 0 || mHeight <= 0)
+		throw Error("OcclusionCuller: invalid depth buffer size %dx%d", mWidth, mHeight);
+
+	mDepth.assign(std::size_t(mTilesX) * mTilesY * kTileSize_, 0.f);
+	mTileMin.assign(std::size_t(mTilesX) * mTilesY, 0.f);
+
+	auto workers = aOptions.workers;
+	if (0 == workers)
+	{
+		auto const hw = std::thread::hardware_concurrency();
+		workers = hw > 1 ? hw - 1 : 1;
+	}
+	workers = std::min(workers, std::size_t(mTilesY));
+
+	// Each worker owns a band of tile rows for the lifetime of the culler.
+	for (std::size_t i = 0; i < workers; ++i)
+	{
+		int const row0 = int(i * mTilesY / workers);
+		int const row1 = int((i + 1) * mTilesY / workers);
+		mWorkers.emplace_back([this, row0, row1] { worker_(row0, row1); });
+	}
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+	}
+	mWorkReady.notify_all();
+
+	for (auto& worker : mWorkers)
+		worker.join();
+}
+
+void OcclusionCuller::begin(Mat44f const& aProjCameraWorld)
+{
+	auto const start = Clock::now();
+
+	// The workers still use mTriangles if the previous frame was not culled.
+	wait_();
+
+	mProjCameraWorld = aProjCameraWorld;
+	mTriangles.clear();
+
+	auto const& m = aProjCameraWorld;
+	float const halfW = 0.5f * float(mWidth), halfH = 0.5f * float(mHeight);
+
+	auto const to_clip = [&] (Vec3f const& aP) {
+		return ClipVertex_{
+			m(0,0) * aP.x + m(0,1) * aP.y + m(0,2) * aP.z + m(0,3),
+			m(1,0) * aP.x + m(1,1) * aP.y + m(1,2) * aP.z + m(1,3),
+			m(3,0) * aP.x + m(3,1) * aP.y + m(3,2) * aP.z + m(3,3)
+		};
+	};
+
+	auto const setup = [&] (ClipVertex_ const& aV0, ClipVertex_ const& aV1, ClipVertex_ const& aV2) {
+		float sx[3], sy[3], iw[3];
+		ClipVertex_ const* const v[3] = { &aV0, &aV1, &aV2 };
+		for (int i = 0; i < 3; ++i)
+		{
+			iw[i] = 1.f / v[i]->w;
+			sx[i] = (v[i]->x * iw[i] + 1.f) * halfW;
+			sy[i] = (v[i]->y * iw[i] + 1.f) * halfH;
+		}
+
+		// Back-facing or degenerate.
+		float const area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+		if (!(area > 0.f))
+			return;
+
+		Triangle_ tri;
+		tri.x0 = std::max(0, int(std::floor(std::min({ sx[0], sx[1], sx[2] }))));
+		tri.y0 = std::max(0, int(std::floor(std::min({ sy[0], sy[1], sy[2] }))));
+		tri.x1 = std::min(mWidth, int(std::ceil(std::max({ sx[0], sx[1], sx[2] }))));
+		tri.y1 = std::min(mHeight, int(std::ceil(std::max({ sy[0], sy[1], sy[2] }))));
+		if (tri.x0 >= tri.x1 || tri.y0 >= tri.y1)
+			return;
+
+		// Edge i is opposite of vertex i; positive on the inside.
+		float depthA = 0.f, depthB = 0.f, depthC = 0.f;
+		for (int i = 0; i < 3; ++i)
+		{
+			int const a = (i + 1) % 3, b = (i + 2) % 3;
+			tri.edgeA[i] = sy[a] - sy[b];
+			tri.edgeB[i] = sx[b] - sx[a];
+			tri.edgeC[i] = -(tri.edgeA[i] * sx[a] + tri.edgeB[i] * sy[a]);
+
+			depthA += tri.edgeA[i] * iw[i];
+			depthB += tri.edgeB[i] * iw[i];
+			depthC += tri.edgeC[i] * iw[i];
+		}
+
+		float const invArea = 1.f / area;
+		tri.depthA = depthA * invArea;
+		tri.depthB = depthB * invArea;
+		tri.depthC = depthC * invArea;
+
+		mTriangles.emplace_back(tri);
+	};
+
+	for (std::size_t i = 0; i + 2 < mOccluders.size(); i += 3)
+	{
+		ClipVertex_ const in[3] = { to_clip(mOccluders[i]), to_clip(mOccluders[i + 1]), to_clip(mOccluders[i + 2]) };
+
+		if (in[0].w >= kNearW_ && in[1].w >= kNearW_ && in[2].w >= kNearW_)
+		{
+			setup(in[0], in[1], in[2]);
+			continue;
+		}
+
+		ClipVertex_ out[4];
+		int const count = clip_near_(in, out);
+		if (count >= 3)
+			setup(out[0], out[1], out[2]);
+		if (4 == count)
+			setup(out[0], out[2], out[3]);
+	}
+
+	mRasterStart = Clock::now();
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		++mGeneration;
+		mBusy = mWorkers.size();
+	}
+	mWorkReady.notify_all();
+	mPending = true;
+
+	mStats.cullSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void OcclusionCuller::cull(std::span<DrawChunk const> aChunks, std::vector<GLint>& aFirsts, std::vector<GLsizei>& aCounts)
+{
+	auto const start = Clock::now();
+
+	if (!mPending)
+		throw Error("OcclusionCuller::cull(): not preceded by begin()");
+
+	wait_();
+
+	aFirsts.clear();
+	aCounts.clear();
+
+	for (auto const& chunk : aChunks)
+	{
+		++mStats.candidates;
+		mStats.triangles += std::size_t(chunk.count) / 3;
+
+		bool outside = false;
+		if (!visible_(chunk, outside))
+		{
+			++(outside ? mStats.outside : mStats.occluded);
+			mStats.occludedTriangles += std::size_t(chunk.count) / 3;
+			continue;
+		}
+
+		if (!aFirsts.empty() && aFirsts.back() + aCounts.back() == chunk.first)
+			aCounts.back() += chunk.count;
+		else
+		{
+			aFirsts.emplace_back(chunk.first);
+			aCounts.emplace_back(chunk.count);
+		}
+	}
+
+	++mStats.frames;
+	mStats.cullSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+OcclusionStats OcclusionCuller::report()
+{
+	auto const ret = mStats;
+	mStats = {};
+	return ret;
+}
+
+bool OcclusionCuller::uses_avx2() const noexcept
+{
+	return mAvx2;
+}
+std::size_t OcclusionCuller::worker_count() const noexcept
+{
+	return mWorkers.size();
+}
+std::size_t OcclusionCuller::occluder_triangle_count() const noexcept
+{
+	return mOccluders.size() / 3;
+}
+std::span<float const> OcclusionCuller::depth_buffer() const noexcept
+{
+	return mDepth;
+}
+
+void OcclusionCuller::wait_()
+{
+	if (!mPending)
+		return;
+
+	Clock::time_point end;
+	{
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWorkDone.wait(lock, [this] { return 0 == mBusy; });
+		end = mRasterEnd;
+	}
+
+	mStats.rasterSeconds += std::chrono::duration<double>(end - mRasterStart).count();
+	mPending = false;
+}
+
+bool OcclusionCuller::visible_(DrawChunk const& aChunk, bool& aOutside) const
+{
+	auto const& m = mProjCameraWorld;
+	auto const& lo = aChunk.boundsMin;
+	auto const& hi = aChunk.boundsMax;
+
+	float minX = kInf_, minY = kInf_, maxX = -kInf_, maxY = -kInf_;
+	float minW = kInf_;
+	bool left = true, right = true, below = true, above = true, behind = true;
+	for (int i = 0; i < 8; ++i)
+	{
+		float const x = (i & 1) ? hi.x : lo.x;
+		float const y = (i & 2) ? hi.y : lo.y;
+		float const z = (i & 4) ? hi.z : lo.z;
+
+		float const cx = m(0,0) * x + m(0,1) * y + m(0,2) * z + m(0,3);
+		float const cy = m(1,0) * x + m(1,1) * y + m(1,2) * z + m(1,3);
+		float const cw = m(3,0) * x + m(3,1) * y + m(3,2) * z + m(3,3);
+
+		// Outside of the view if all corners are outside of the same plane;
+		// this works regardless of the sign of w.
+		left = left && cx < -cw;
+		right = right && cx > cw;
+		below = below && cy < -cw;
+		above = above && cy > cw;
+		behind = behind && cw <= 0.f;
+
+		minW = std::min(minW, cw);
+		if (cw < kNearW_)
+			continue;
+
+		float const sx = (cx / cw + 1.f) * 0.5f * float(mWidth);
+		float const sy = (cy / cw + 1.f) * 0.5f * float(mHeight);
+		minX = std::min(minX, sx); maxX = std::max(maxX, sx);
+		minY = std::min(minY, sy); maxY = std::max(maxY, sy);
+	}
+
+	if (left || right || below || above || behind)
+	{
+		aOutside = true;
+		return false;
+	}
+
+	// Reaches too close to the camera to project.
+	if (minW < kNearW_)
+		return true;
+
+	int const x0 = std::max(0, int(std::floor(minX)));
+	int const y0 = std::max(0, int(std::floor(minY)));
+	int const x1 = std::min(mWidth, int(std::ceil(maxX)));
+	int const y1 = std::min(mHeight, int(std::ceil(maxY)));
+	if (x0 >= x1 || y0 >= y1)
+	{
+		aOutside = true;
+		return false;
+	}
+
+	// Nearest point of the box; the box is hidden if the occluders are nearer
+	// than this everywhere in its screen rectangle.
+	float const nearest = 1.f / minW;
+
+	for (int ty = tile_row_begin_(y0); ty < tile_row_end_(y1); ++ty)
+	{
+		for (int tx = x0 / kTileW_; tx <= (x1 - 1) / kTileW_; ++tx)
+		{
+			auto const tile = std::size_t(ty) * mTilesX + tx;
+			if (mTileMin[tile] > nearest)
+				continue;
+
+			float const* depth = mDepth.data() + tile * kTileSize_;
+			for (int y = std::max(y0, ty * kTileH_); y < std::min(y1, (ty + 1) * kTileH_); ++y)
+			{
+				for (int x = std::max(x0, tx * kTileW_); x < std::min(x1, (tx + 1) * kTileW_); ++x)
+				{
+					if (!(depth[(y - ty * kTileH_) * kTileW_ + (x - tx * kTileW_)] > nearest))
+						return true;
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+void OcclusionCuller::worker_(int aTileRow0, int aTileRow1)
+{
+	std::uint64_t generation = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWorkReady.wait(lock, [&] { return mStop || generation != mGeneration; });
+			if (mStop)
+				return;
+
+			generation = mGeneration;
+		}
+
+		rasterize_(aTileRow0, aTileRow1);
+
+		bool last = false;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			last = 0 == --mBusy;
+			if (last)
+				mRasterEnd = Clock::now();
+		}
+		if (last)
+			mWorkDone.notify_all();
+	}
+}
+
+void OcclusionCuller::rasterize_(int aTileRow0, int aTileRow1)
+{
+	auto const tileBegin = std::size_t(aTileRow0) * mTilesX;
+	auto const tileEnd = std::size_t(aTileRow1) * mTilesX;
+	std::fill(mDepth.begin() + std::ptrdiff_t(tileBegin * kTileSize_), mDepth.begin() + std::ptrdiff_t(tileEnd * kTileSize_), 0.f);
+
+	for (auto const& tri : mTriangles)
+	{
+		int const row0 = std::max(aTileRow0, tile_row_begin_(tri.y0));
+		int const row1 = std::min(aTileRow1, tile_row_end_(tri.y1));
+		if (row0 >= row1)
+			continue;
+
+		if (mAvx2)
+			rasterize_avx2_(tri, row0, row1);
+		else
+			rasterize_scalar_(tri, row0, row1);
+	}
+
+	for (auto tile = tileBegin; tile < tileEnd; ++tile)
+	{
+		float const* depth = mDepth.data() + tile * kTileSize_;
+		mTileMin[tile] = *std::min_element(depth, depth + kTileSize_);
+	}
+}
+
+// Both rasterizers evaluate the edge and depth planes at pixel centres with
+// the same operations in the same order, so that their results are
+// identical.
+void OcclusionCuller::rasterize_scalar_(Triangle_ const& aTri, int aTileRow0, int aTileRow1)
+{
+	int const y0 = std::max(aTri.y0, aTileRow0 * kTileH_);
+	int const y1 = std::min(aTri.y1, aTileRow1 * kTileH_);
+
+	for (int y = y0; y < y1; ++y)
+	{
+		float const py = float(y) + 0.5f;
+		int const ty = y / kTileH_;
+
+		float rowEdge[3];
+		for (int i = 0; i < 3; ++i)
+			rowEdge[i] = aTri.edgeB[i] * py + aTri.edgeC[i];
+		float const rowDepth = aTri.depthB * py + aTri.depthC;
+
+		for (int x = aTri.x0; x < aTri.x1; ++x)
+		{
+			float const px = float(x) + 0.5f;
+			if (aTri.edgeA[0] * px + rowEdge[0] < 0.f || aTri.edgeA[1] * px + rowEdge[1] < 0.f || aTri.edgeA[2] * px + rowEdge[2] < 0.f)
+				continue;
+
+			auto const tile = std::size_t(ty) * mTilesX + x / kTileW_;
+			float& depth = mDepth[tile * kTileSize_ + (y % kTileH_) * kTileW_ + x % kTileW_];
+			depth = std::max(depth, aTri.depthA * px + rowDepth);
+		}
+	}
+}
+
+OCCLUSION_TARGET_AVX2_
+void OcclusionCuller::rasterize_avx2_(Triangle_ const& aTri, int aTileRow0, int aTileRow1)
+{
+	__m256i const lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	__m256 const laneCentre = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+	__m256i const xBegin = _mm256_set1_epi32(aTri.x0 - 1);
+	__m256i const xEnd = _mm256_set1_epi32(aTri.x1);
+	__m256 const zero = _mm256_setzero_ps();
+
+	__m256 const edgeA0 = _mm256_set1_ps(aTri.edgeA[0]);
+	__m256 const edgeA1 = _mm256_set1_ps(aTri.edgeA[1]);
+	__m256 const edgeA2 = _mm256_set1_ps(aTri.edgeA[2]);
+	__m256 const depthA = _mm256_set1_ps(aTri.depthA);
+
+	int const y0 = std::max(aTri.y0, aTileRow0 * kTileH_);
+	int const y1 = std::min(aTri.y1, aTileRow1 * kTileH_);
+	int const tx0 = aTri.x0 / kTileW_;
+	int const tx1 = (aTri.x1 - 1) / kTileW_;
+
+	for (int y = y0; y < y1; ++y)
+	{
+		float const py = float(y) + 0.5f;
+		int const ty = y / kTileH_;
+
+		__m256 const rowEdge0 = _mm256_set1_ps(aTri.edgeB[0] * py + aTri.edgeC[0]);
+		__m256 const rowEdge1 = _mm256_set1_ps(aTri.edgeB[1] * py + aTri.edgeC[1]);
+		__m256 const rowEdge2 = _mm256_set1_ps(aTri.edgeB[2] * py + aTri.edgeC[2]);
+		__m256 const rowDepth = _mm256_set1_ps(aTri.depthB * py + aTri.depthC);
+
+		float* row = mDepth.data() + (std::size_t(ty) * mTilesX * kTileSize_) + (y % kTileH_) * kTileW_;
+
+		for (int tx = tx0; tx <= tx1; ++tx)
+		{
+			// Pixel columns of this tile row that lie in [x0, x1).
+			__m256i const x = _mm256_add_epi32(_mm256_set1_epi32(tx * kTileW_), lane);
+			__m256i const inX = _mm256_and_si256(_mm256_cmpgt_epi32(x, xBegin), _mm256_cmpgt_epi32(xEnd, x));
+
+			__m256 const px = _mm256_add_ps(_mm256_set1_ps(float(tx * kTileW_)), laneCentre);
+			__m256 const e0 = _mm256_add_ps(_mm256_mul_ps(edgeA0, px), rowEdge0);
+			__m256 const e1 = _mm256_add_ps(_mm256_mul_ps(edgeA1, px), rowEdge1);
+			__m256 const e2 = _mm256_add_ps(_mm256_mul_ps(edgeA2, px), rowEdge2);
+
+			__m256 const inside = _mm256_and_ps(
+				_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(e2, zero, _CMP_GE_OQ), _mm256_castsi256_ps(inX))
+			);
+			if (0 == _mm256_movemask_ps(inside))
+				continue;
+
+			float* dst = row + std::size_t(tx) * kTileSize_;
+			__m256 const old = _mm256_loadu_ps(dst);
+			__m256 const depth = _mm256_max_ps(old, _mm256_add_ps(_mm256_mul_ps(depthA, px), rowDepth));
+			_mm256_storeu_ps(dst, _mm256_blendv_ps(old, depth, inside));
+		}
+	}
+}
@@ -0,0 +1,158 @@
+#ifndef OCCLUSION_HPP_7349A009_B2A4_4227_B6B6_88DC0CD6D7AE
+#define OCCLUSION_HPP_7349A009_B2A4_4227_B6B6_88DC0CD6D7AE
+
+#include <glad/glad.h>
+
+#include <span>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <condition_variable>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "defaults.hpp"
+#include "simple_mesh.hpp"
+
+/* CPU occlusion culling.
+ *
+ * Simplified occluder triangles are rasterized into a small depth buffer
+ * (320x180 by default), and the bounding boxes of draw chunks are tested
+ * against it before the draw is submitted. The depth buffer holds 1/w,
+ * which is linear in screen space; larger values are nearer, and 0 is the
+ * far plane. It is stored in tiles of 8x4 pixels, one AVX2 register per
+ * tile row, and keeps the farthest depth of each tile as a second, coarse
+ * level. Boxes are first tested against that level and only go down to the
+ * pixels if the coarse test is inconclusive.
+ *
+ * Occluders must be conservative, i.e., lie inside or behind the geometry
+ * they stand in for, and are one-sided: triangles that are counter-clockwise
+ * when seen from the front are rasterized, others are skipped.
+ *
+ * begin() sets up the occluder triangles for a frame and hands them to the
+ * worker threads, each of which rasterizes a band of tile rows. cull() waits
+ * for them; anything the caller does in between (e.g., issuing GL commands
+ * while the GPU is still busy with the previous frame) overlaps with the
+ * rasterization.
+ *
+ * The AVX2 rasterizer is selected at runtime if the CPU supports it; there is
+ * a scalar fallback that produces identical results.
+ */
+
+// Contiguous range of vertices (GL_TRIANGLES) with its world-space bounds.
+struct DrawChunk
+{
+	GLint first;
+	GLsizei count;
+	Vec3f boundsMin, boundsMax;
+};
+
+// Reorders the triangles of aMesh into aGrid x aGrid cells in the XZ plane
+// (by centroid) and returns one chunk per non-empty cell. Chunk ranges start
+// at aFirstVertex, so that the mesh can be concatenated after others.
+std::vector<DrawChunk> make_draw_chunks(SimpleMeshData& aMesh, std::size_t aGrid, GLint aFirstVertex = 0);
+
+// Conservative occluder for a height field (e.g., the terrain): a regular
+// grid of aGrid x aGrid cells over the mesh's XZ extent, where each grid
+// vertex takes the lowest terrain height around it. The outermost ring of
+// cells is left out. Returns a triangle soup (three vertices per triangle)
+// facing upwards.
+std::vector<Vec3f> make_heightfield_occluder(SimpleMeshData const& aTerrain, std::size_t aGrid);
+
+struct OcclusionStats
+{
+	std::size_t frames = 0;
+	std::size_t candidates = 0;         // chunks tested
+	std::size_t occluded = 0;           // ... hidden by occluders
+	std::size_t outside = 0;            // ... outside of the view
+	std::size_t triangles = 0;          // in all candidates
+	std::size_t occludedTriangles = 0;  // in occluded or outside candidates
+	double cullSeconds = 0.;            // calling thread, in begin() and cull()
+	double rasterSeconds = 0.;          // rasterization, wall time
+};
+
+struct OcclusionOptions
+{
+	int width = 320;
+	int height = 180;
+	std::size_t workers = 0;  // 0: one per core, less one for the render thread
+	bool allowAvx2 = true;
+};
+
+class OcclusionCuller
+{
+	public:
+		explicit OcclusionCuller(std::vector<Vec3f> aOccluderTriangles, OcclusionOptions const& = {});
+		~OcclusionCuller();
+
+		OcclusionCuller(OcclusionCuller const&) = delete;
+		OcclusionCuller& operator=(OcclusionCuller const&) = delete;
+
+	public:
+		// Starts rasterizing the occluders as seen through aProjCameraWorld.
+		void begin(Mat44f const& aProjCameraWorld);
+
+		// Tests aChunks (as seen through the matrix passed to begin()) and
+		// writes the visible ones to aFirsts and aCounts, merging adjacent
+		// ranges, for glMultiDrawArrays().
+		void cull(std::span<DrawChunk const> aChunks, std::vector<GLint>& aFirsts, std::vector<GLsizei>& aCounts);
+
+		// Statistics since the previous call.
+		OcclusionStats report();
+
+		bool uses_avx2() const noexcept;
+		std::size_t worker_count() const noexcept;
+		std::size_t occluder_triangle_count() const noexcept;
+
+		// Depth buffer as of the last cull(), tile-major (see above). For
+		// tests and debug views.
+		std::span<float const> depth_buffer() const noexcept;
+
+	private:
+		// Edge functions (inside if all >= 0) and 1/w, as planes a*x + b*y + c
+		// in pixel coordinates, plus the pixel bounds of the triangle.
+		struct Triangle_
+		{
+			float edgeA[3], edgeB[3], edgeC[3];
+			float depthA, depthB, depthC;
+			int x0, y0, x1, y1;  // inclusive-exclusive
+		};
+
+		void rasterize_(int aTileRow0, int aTileRow1);
+		void rasterize_scalar_(Triangle_ const&, int aTileRow0, int aTileRow1);
+		void rasterize_avx2_(Triangle_ const&, int aTileRow0, int aTileRow1);
+		void wait_();
+		bool visible_(DrawChunk const&, bool& aOutside) const;
+
+		void worker_(int aTileRow0, int aTileRow1);
+
+	private:
+		std::vector<Vec3f> mOccluders;
+
+		int mWidth, mHeight;
+		int mTilesX, mTilesY;
+		bool mAvx2;
+
+		std::vector<float> mDepth;    // tile-major, 32 pixels per tile
+		std::vector<float> mTileMin;  // farthest depth per tile
+		std::vector<Triangle_> mTriangles;
+
+		Mat44f mProjCameraWorld;
+		bool mPending = false;
+		Clock::time_point mRasterStart, mRasterEnd;
+
+		std::mutex mMutex;
+		std::condition_variable mWorkReady, mWorkDone;
+		std::uint64_t mGeneration = 0;
+		std::size_t mBusy = 0;
+		bool mStop = false;
+		std::vector<std::thread> mWorkers;
+
+		OcclusionStats mStats;
+};
+
+#endif // OCCLUSION_HPP_7349A009_B2A4_4227_B6B6_88DC0CD6D7AE
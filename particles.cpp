@@ -0,0 +1,444 @@
+#include "particles.hpp"
+
+#include <numbers>
+#include <algorithm>
+
+#include <cmath>
+#include <cstring>
+
+#include "../support/error.hpp"
+
+namespace
+{
+	// local_size_x of particles-simulate.comp and particles-emit.comp;
+	// checked when the programs are loaded.
+	constexpr unsigned kLocalSize_ = 256;
+	constexpr unsigned kEmitterRingSize_ = 3;
+
+	// Binding points shared by the compute and draw shaders.
+	constexpr GLuint kBindSrcParticles_ = 0;
+	constexpr GLuint kBindSrcCounters_ = 1;
+	constexpr GLuint kBindDstCounters_ = 2;
+	constexpr GLuint kBindDstParticles_ = 3;
+	constexpr GLuint kBindEmitters_ = 4;
+
+	// Matches the Counters block in the shaders (assets/cw2/particles-*). The
+	// first four members are a DrawArraysIndirectCommand, the next three a
+	// DispatchIndirectCommand.
+	struct Counters_
+	{
+		GLuint count, instanceCount, first, baseInstance;
+		GLuint groupsX, groupsY, groupsZ;
+		GLuint pad;
+	};
+
+	static_assert(sizeof(Counters_) == 32);
+
+	constexpr GLintptr kDispatchOffset_ = offsetof(Counters_, groupsX);
+
+	std::uint32_t hash_u32_(std::uint32_t aX) noexcept
+	{
+		aX ^= aX >> 16; aX *= 0x7feb352du;
+		aX ^= aX >> 15; aX *= 0x846ca68bu;
+		aX ^= aX >> 16;
+		return aX;
+	}
+
+	float rand01_(std::uint32_t& aState) noexcept
+	{
+		aState = hash_u32_(aState);
+		return float(aState >> 8) * (1.f / 16777216.f);
+	}
+
+	Vec3f rand_unit_(std::uint32_t& aState) noexcept
+	{
+		float const z = 2.f * rand01_(aState) - 1.f;
+		float const a = 2.f * std::numbers::pi_v<float> * rand01_(aState);
+		float const s = std::sqrt(std::max(0.f, 1.f - z * z));
+		return { s * std::cos(a), s * std::sin(a), z };
+	}
+
+	// CPU equivalent of particles-emit.comp, for a single particle.
+	Particle spawn_(ParticleEmitterGpu const& aEm, std::uint32_t aState) noexcept
+	{
+		float const life = aEm.lifeMin + (aEm.lifeMax - aEm.lifeMin) * rand01_(aState);
+		Vec3f const dir = rand_unit_(aState);
+		Vec3f const unit = rand_unit_(aState);
+		Vec3f const offset = unit * (aEm.positionRadius.w * rand01_(aState));
+		float const scale = 1.f + aEm.speedJitter * (2.f * rand01_(aState) - 1.f);
+
+		Vec3f const mean{ aEm.velocitySpread.x, aEm.velocitySpread.y, aEm.velocitySpread.z };
+		Vec3f const v = mean * scale + dir * (aEm.velocitySpread.w * length(mean));
+
+		return {
+			{ aEm.positionRadius.x + offset.x, aEm.positionRadius.y + offset.y, aEm.positionRadius.z + offset.z, 0.f },
+			{ v.x, v.y, v.z, life }
+		};
+	}
+
+	// CPU equivalent of particles-simulate.comp. Returns false if the
+	// particle died.
+	bool simulate_(Particle& aP, float aDt, ParticleForces const& aForces) noexcept
+	{
+		aP.posAge.w += aDt;
+		if (aP.posAge.w >= aP.velLife.w)
+			return false;
+
+		Vec3f v{ aP.velLife.x, aP.velLife.y, aP.velLife.z };
+		v += aForces.acceleration * aDt;
+		v *= std::max(0.f, 1.f - aForces.drag * aDt);
+
+		aP.posAge.x += v.x * aDt;
+		aP.posAge.y += v.y * aDt;
+		aP.posAge.z += v.z * aDt;
+		aP.velLife.x = v.x;
+		aP.velLife.y = v.y;
+		aP.velLife.z = v.z;
+		return true;
+	}
+}
+
+std::uint32_t plan_particle_emission(float aDt, std::span<ParticleEmitter const> aEmitters, std::vector<float>& aAccumulators, ParticleEmitterGpu (&aOut)[kMaxParticleEmitters])
+{
+	if (aEmitters.size() > kMaxParticleEmitters)
+		throw Error("Too many particle emitters (%zu, max %zu)", aEmitters.size(), kMaxParticleEmitters);
+
+	aAccumulators.resize(aEmitters.size(), 0.f);
+
+	std::uint32_t total = 0;
+	for (std::size_t i = 0; i < aEmitters.size(); ++i)
+	{
+		auto const& em = aEmitters[i];
+
+		aAccumulators[i] += em.rate * aDt;
+		auto const spawn = std::uint32_t(aAccumulators[i]);
+		aAccumulators[i] -= float(spawn);
+
+		aOut[i] = {
+			{ em.position.x, em.position.y, em.position.z, em.radius },
+			{ em.velocity.x, em.velocity.y, em.velocity.z, em.spread },
+			em.speedJitter,
+			em.lifeMin, em.lifeMax,
+			spawn
+		};
+		total += spawn;
+	}
+
+	return total;
+}
+
+
+ParticleSystem::ParticleSystem(std::size_t aCapacity)
+	: mCapacity(aCapacity)
+	, mProgPrepare({ { GL_COMPUTE_SHADER, "assets/cw2/particles-prepare.comp" } })
+	, mProgSimulate({ { GL_COMPUTE_SHADER, "assets/cw2/particles-simulate.comp" } })
+	, mProgEmit({ { GL_COMPUTE_SHADER, "assets/cw2/particles-emit.comp" } })
+	, mProgFinalize({ { GL_COMPUTE_SHADER, "assets/cw2/particles-finalize.comp" } })
+	, mProgDraw({
+		{ GL_VERTEX_SHADER, "assets/cw2/particles.vert" },
+		{ GL_FRAGMENT_SHADER, "assets/cw2/particles.frag" }
+	})
+{
+	// Simulation and emission are dispatched with one invocation per
+	// particle (at most mCapacity), in groups of kLocalSize_ along x.
+	GLint maxGroupsX = 0;
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroupsX);
+
+	auto const groups = (mCapacity + kLocalSize_ - 1) / kLocalSize_;
+	if (0 == mCapacity || groups > std::size_t(maxGroupsX))
+		throw Error("Particle capacity %zu is out of range (1..%zu with GL_MAX_COMPUTE_WORK_GROUP_COUNT %d)", mCapacity, std::size_t(maxGroupsX) * kLocalSize_, maxGroupsX);
+
+	for (auto const* prog : { &mProgSimulate, &mProgEmit })
+	{
+		GLint size[3] = {};
+		glGetProgramiv(prog->programId(), GL_COMPUTE_WORK_GROUP_SIZE, size);
+		if (GLint(kLocalSize_) != size[0])
+			throw Error("Particle shaders: local_size_x is %d, expected %u", size[0], kLocalSize_);
+	}
+
+	glGenBuffers(2, mParticles);
+	glGenBuffers(2, mCounters);
+	for (unsigned i = 0; i < 2; ++i)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mParticles[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(mCapacity * sizeof(Particle)), nullptr, GL_DYNAMIC_COPY);
+
+		Counters_ const empty{ 4, 0, 0, 0, 0, 1, 1, 0 };
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCounters[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Counters_), &empty, GL_DYNAMIC_COPY);
+	}
+
+	// Emitter ring. Each region must start at a valid SSBO binding offset.
+	GLint align = 1;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &align);
+	auto const bytes = GLsizeiptr(kMaxParticleEmitters * sizeof(ParticleEmitterGpu));
+	mEmitterRegionSize = (bytes + align - 1) / align * align;
+
+	glGenBuffers(1, &mEmitterRing);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mEmitterRing);
+
+#	if defined(GL_VERSION_4_4)
+	if (GLAD_GL_VERSION_4_4)
+	{
+		GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_SHADER_STORAGE_BUFFER, kEmitterRingSize_ * mEmitterRegionSize, nullptr, flags);
+		mEmitterMapping = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, kEmitterRingSize_ * mEmitterRegionSize, flags);
+		if (!mEmitterMapping)
+			throw Error("Unable to persistently map particle emitter buffer");
+	}
+#	endif // ~ GL_VERSION_4_4
+
+	if (!mEmitterMapping)
+		glBufferData(GL_SHADER_STORAGE_BUFFER, kEmitterRingSize_ * mEmitterRegionSize, nullptr, GL_STREAM_DRAW);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	// Core profile requires a VAO for drawing, even if all data comes from
+	// the SSBO.
+	glGenVertexArrays(1, &mDrawVao);
+}
+
+ParticleSystem::~ParticleSystem()
+{
+	for (auto& fence : mEmitterFences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+	}
+
+	if (mEmitterMapping)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mEmitterRing);
+		glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	glDeleteVertexArrays(1, &mDrawVao);
+	glDeleteBuffers(1, &mEmitterRing);
+	glDeleteBuffers(2, mCounters);
+	glDeleteBuffers(2, mParticles);
+}
+
+void ParticleSystem::update(float aDt, std::span<ParticleEmitter const> aEmitters, ParticleForces const& aForces)
+{
+	ParticleEmitterGpu emitters[kMaxParticleEmitters];
+	auto const totalSpawn = plan_particle_emission(aDt, aEmitters, mAccumulators, emitters);
+	auto const seed = hash_u32_(mFrame++);
+
+	unsigned const src = mCurrent;
+	unsigned const dst = 1 - mCurrent;
+
+	// Stream emitter parameters into the next ring region. The fence makes
+	// sure the GPU has finished reading it (kEmitterRingSize_ updates ago).
+	unsigned const region = mEmitterRegion;
+	mEmitterRegion = (mEmitterRegion + 1) % kEmitterRingSize_;
+
+	if (auto& fence = mEmitterFences[region])
+	{
+		while (GL_TIMEOUT_EXPIRED == glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1'000'000))
+			;
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+
+	auto const offset = GLintptr(region) * mEmitterRegionSize;
+	auto const bytes = aEmitters.size() * sizeof(ParticleEmitterGpu);
+	if (mEmitterMapping)
+	{
+		std::memcpy(static_cast<std::byte*>(mEmitterMapping) + offset, emitters, bytes);
+	}
+	else
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mEmitterRing);
+		GLbitfield const flags = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+		if (void* ptr = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, offset, mEmitterRegionSize, flags))
+		{
+			std::memcpy(ptr, emitters, bytes);
+			glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		}
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kBindSrcParticles_, mParticles[src]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kBindDstParticles_, mParticles[dst]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kBindSrcCounters_, mCounters[src]);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kBindDstCounters_, mCounters[dst]);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, kBindEmitters_, mEmitterRing, offset, mEmitterRegionSize);
+
+	// Prepare: dispatch size for the simulation, reset the output count.
+	glUseProgram(mProgPrepare.programId());
+	glUniform1ui(0, kLocalSize_);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+	// Simulate and compact the surviving particles.
+	glUseProgram(mProgSimulate.programId());
+	glUniform1f(0, aDt);
+	glUniform3f(1, aForces.acceleration.x, aForces.acceleration.y, aForces.acceleration.z);
+	glUniform1f(2, aForces.drag);
+
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, mCounters[src]);
+	glDispatchComputeIndirect(kDispatchOffset_);
+	glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Emit
+	if (totalSpawn)
+	{
+		glUseProgram(mProgEmit.programId());
+		glUniform1ui(0, totalSpawn);
+		glUniform1ui(1, GLuint(aEmitters.size()));
+		glUniform1ui(2, seed);
+		glUniform1ui(3, GLuint(mCapacity));
+		// No more than mCapacity particles fit; the rest would be dropped by
+		// the shader anyway. This keeps the dispatch within the group limit.
+		auto const invocations = std::min<std::size_t>(totalSpawn, mCapacity);
+		glDispatchCompute(GLuint((invocations + kLocalSize_ - 1) / kLocalSize_), 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	mEmitterFences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// Finalize
+	glUseProgram(mProgFinalize.programId());
+	glUniform1ui(3, GLuint(mCapacity));
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+	glUseProgram(0);
+
+	mCurrent = dst;
+}
+
+void ParticleSystem::draw(Mat44f const& aProjCameraWorld, Mat44f const& aWorld2Camera, float aSize)
+{
+	glUseProgram(mProgDraw.programId());
+	glUniformMatrix4fv(0, 1, GL_TRUE, aProjCameraWorld.v);
+	// Camera axes in world space are the rows of the rotation part.
+	glUniform3f(1, aWorld2Camera(0, 0), aWorld2Camera(0, 1), aWorld2Camera(0, 2));
+	glUniform3f(2, aWorld2Camera(1, 0), aWorld2Camera(1, 1), aWorld2Camera(1, 2));
+	glUniform1f(3, aSize);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kBindSrcParticles_, mParticles[mCurrent]);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCounters[mCurrent]);
+
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_CULL_FACE);
+
+	glBindVertexArray(mDrawVao);
+	glDrawArraysIndirect(GL_TRIANGLE_STRIP, nullptr);
+	glBindVertexArray(0);
+
+	glEnable(GL_CULL_FACE);
+	glDepthMask(GL_TRUE);
+	glDisable(GL_BLEND);
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	glUseProgram(0);
+}
+
+std::size_t ParticleSystem::capacity() const noexcept
+{
+	return mCapacity;
+}
+bool ParticleSystem::persistentlyMapped() const noexcept
+{
+	return nullptr != mEmitterMapping;
+}
+
+std::vector<Particle> ParticleSystem::read_back() const
+{
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	Counters_ counters{};
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCounters[mCurrent]);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Counters_), &counters);
+
+	std::vector<Particle> ret(counters.instanceCount);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, mParticles[mCurrent]);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, GLsizeiptr(ret.size() * sizeof(Particle)), ret.data());
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	return ret;
+}
+
+
+ParticleSystemCpu::ParticleSystemCpu(std::size_t aCapacity)
+	: mCapacity(aCapacity)
+{
+	mParticles.reserve(mCapacity);
+}
+
+void ParticleSystemCpu::update(float aDt, std::span<ParticleEmitter const> aEmitters, ParticleForces const& aForces)
+{
+	ParticleEmitterGpu emitters[kMaxParticleEmitters];
+	plan_particle_emission(aDt, aEmitters, mAccumulators, emitters);
+	auto const seed = hash_u32_(mFrame++);
+
+	// Simulate and compact in place.
+	auto const end = std::remove_if(mParticles.begin(), mParticles.end(), [&] (Particle& aP) {
+		return !simulate_(aP, aDt, aForces);
+	});
+	mParticles.erase(end, mParticles.end());
+
+	// Emit, in the same order as the global invocation IDs of the shader.
+	std::uint32_t gid = 0;
+	for (std::size_t e = 0; e < aEmitters.size(); ++e)
+	{
+		for (std::uint32_t i = 0; i < emitters[e].spawnCount; ++i, ++gid)
+		{
+			if (mParticles.size() < mCapacity)
+				mParticles.emplace_back(spawn_(emitters[e], gid ^ seed));
+		}
+	}
+}
+
+std::span<Particle const> ParticleSystemCpu::particles() const noexcept
+{
+	return mParticles;
+}
+
+
+ParticleSummary summarize_particles(std::span<Particle const> aParticles)
+{
+	ParticleSummary ret;
+	ret.count = aParticles.size();
+	if (aParticles.empty())
+		return ret;
+
+	// Accumulate in double; a million floats loses too much precision.
+	double pos[3] = {}, vel[3] = {}, age = 0., life = 0.;
+	for (auto const& p : aParticles)
+	{
+		pos[0] += p.posAge.x; pos[1] += p.posAge.y; pos[2] += p.posAge.z;
+		vel[0] += p.velLife.x; vel[1] += p.velLife.y; vel[2] += p.velLife.z;
+		age += p.posAge.w;
+		life += p.velLife.w;
+	}
+
+	double const n = double(aParticles.size());
+	ret.meanPosition = { float(pos[0] / n), float(pos[1] / n), float(pos[2] / n) };
+	ret.meanVelocity = { float(vel[0] / n), float(vel[1] / n), float(vel[2] / n) };
+	ret.meanAge = float(age / n);
+	ret.meanLife = float(life / n);
+	return ret;
+}
+
+bool particle_summaries_match(ParticleSummary const& aA, ParticleSummary const& aB, float aTolerance)
+{
+	if (aA.count != aB.count)
+		return false;
+
+	auto const close = [aTolerance] (float aX, float aY) {
+		return std::abs(aX - aY) <= aTolerance * std::max({ 1.f, std::abs(aX), std::abs(aY) });
+	};
+
+	for (std::size_t i = 0; i < 3; ++i)
+	{
+		if (!close(aA.meanPosition[i], aB.meanPosition[i]) || !close(aA.meanVelocity[i], aB.meanVelocity[i]))
+			return false;
+	}
+
+	return close(aA.meanAge, aB.meanAge) && close(aA.meanLife, aB.meanLife);
+}
@@ -0,0 +1,173 @@
+#ifndef PARTICLES_HPP_C1911FDA_B4A0_457E_8AE9_B898675681D6
+#define PARTICLES_HPP_C1911FDA_B4A0_457E_8AE9_B898675681D6
+
+#include <glad/glad.h>
+
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../vmlib/vec3.hpp"
+#include "../vmlib/vec4.hpp"
+#include "../vmlib/mat44.hpp"
+
+#include "../support/program.hpp"
+
+/* Particle simulation (rocket exhaust and similar effects).
+ *
+ * ParticleSystem runs entirely on the GPU. Each update runs four compute
+ * passes (assets/cw2/particles-*.comp) over a pair of particle SSBOs (read
+ * from one, write to the other):
+ *   - prepare:  derives the dispatch size from the live particle count
+ *   - simulate: integrates and ages particles; survivors are compacted into
+ *               the other buffer with an atomic counter
+ *   - emit:     appends newly spawned particles
+ *   - finalize: clamps the count to the capacity
+ * The live count stays on the GPU. It feeds glDispatchComputeIndirect() in
+ * the next update and the instance count of glDrawArraysIndirect() when
+ * drawing.
+ *
+ * Emitter parameters change every frame. They are written into a ring of
+ * buffer regions, guarded by fences. With GL 4.4 (glBufferStorage) the ring
+ * is persistently mapped; otherwise each region is mapped unsynchronized.
+ *
+ * ParticleSystemCpu implements the same simulation on the CPU. It is the
+ * reference for correctness checks: both produce the same particles, but in
+ * a different order and with small floating point differences, so compare
+ * them with summarize_particles() rather than element by element.
+ */
+
+// Matches the std430 layout in the shaders.
+struct Particle
+{
+	Vec4f posAge;   // xyz = position, w = age in seconds
+	Vec4f velLife;  // xyz = velocity, w = lifetime in seconds
+};
+
+static_assert(sizeof(Particle) == 32);
+
+struct ParticleEmitter
+{
+	Vec3f position;
+	Vec3f velocity;         // mean initial velocity
+	float spread = 0.f;     // random velocity added, relative to |velocity|
+	float speedJitter = 0.f;// random scale of the mean velocity, +/- fraction
+	float radius = 0.f;     // particles spawn in a sphere of this radius
+	float lifeMin = 1.f, lifeMax = 1.f;
+	float rate = 0.f;       // particles per second
+};
+
+struct ParticleForces
+{
+	Vec3f acceleration{ 0.f, 0.f, 0.f };
+	float drag = 0.f;       // fraction of velocity lost per second
+};
+
+inline constexpr std::size_t kMaxParticleEmitters = 16;
+
+// Per-update emitter data, as uploaded to the GPU. Matches the std430 layout
+// in the emit shader.
+struct ParticleEmitterGpu
+{
+	Vec4f positionRadius;
+	Vec4f velocitySpread;
+	float speedJitter;
+	float lifeMin, lifeMax;
+	std::uint32_t spawnCount;
+};
+
+static_assert(sizeof(ParticleEmitterGpu) == 48);
+
+// Turns emitter rates into whole particle counts for this update. The
+// fractional remainder is carried over in aAccumulators (one per emitter).
+// Returns the total number of particles to spawn.
+std::uint32_t plan_particle_emission(
+	float aDt,
+	std::span<ParticleEmitter const> aEmitters,
+	std::vector<float>& aAccumulators,
+	ParticleEmitterGpu (&aOut)[kMaxParticleEmitters]
+);
+
+class ParticleSystem
+{
+	public:
+		explicit ParticleSystem(std::size_t aCapacity);
+		~ParticleSystem();
+
+		ParticleSystem(ParticleSystem const&) = delete;
+		ParticleSystem& operator=(ParticleSystem const&) = delete;
+
+	public:
+		void update(float aDt, std::span<ParticleEmitter const>, ParticleForces const&);
+
+		// Draws the particles as camera-facing quads. Expects the depth
+		// buffer of the opaque scene; sets up (and restores) additive
+		// blending itself.
+		void draw(Mat44f const& aProjCameraWorld, Mat44f const& aWorld2Camera, float aSize);
+
+		std::size_t capacity() const noexcept;
+		bool persistentlyMapped() const noexcept;
+
+		// Reads back the live particles. This stalls the pipeline and is
+		// intended for validation only.
+		std::vector<Particle> read_back() const;
+
+	private:
+		std::size_t mCapacity;
+
+		ShaderProgram mProgPrepare, mProgSimulate, mProgEmit, mProgFinalize;
+		ShaderProgram mProgDraw;
+
+		GLuint mParticles[2] = {};
+		GLuint mCounters[2] = {};
+		unsigned mCurrent = 0;
+
+		GLuint mEmitterRing = 0;
+		GLsizeiptr mEmitterRegionSize = 0;
+		unsigned mEmitterRegion = 0;
+		GLsync mEmitterFences[3] = {};
+		void* mEmitterMapping = nullptr; // persistent mapping, if available
+
+		GLuint mDrawVao = 0;
+
+		std::uint32_t mFrame = 0;
+		std::vector<float> mAccumulators;
+};
+
+class ParticleSystemCpu
+{
+	public:
+		explicit ParticleSystemCpu(std::size_t aCapacity);
+
+	public:
+		void update(float aDt, std::span<ParticleEmitter const>, ParticleForces const&);
+
+		std::span<Particle const> particles() const noexcept;
+
+	private:
+		std::size_t mCapacity;
+		std::vector<Particle> mParticles;
+
+		std::uint32_t mFrame = 0;
+		std::vector<float> mAccumulators;
+};
+
+// Order-independent summary of a particle set.
+struct ParticleSummary
+{
+	std::size_t count = 0;
+	Vec3f meanPosition{ 0.f, 0.f, 0.f };
+	Vec3f meanVelocity{ 0.f, 0.f, 0.f };
+	float meanAge = 0.f;
+	float meanLife = 0.f;
+};
+
+ParticleSummary summarize_particles(std::span<Particle const>);
+
+// True if the counts are equal and the means agree to within aTolerance,
+// relative to their magnitude (but at least absolute aTolerance).
+bool particle_summaries_match(ParticleSummary const&, ParticleSummary const&, float aTolerance = 1e-3f);
+
+#endif // PARTICLES_HPP_C1911FDA_B4A0_457E_8AE9_B898675681D6
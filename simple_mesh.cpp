@@ -1,10 +1,48 @@
 #include "simple_mesh.hpp"
 
+#include "../vmlib/vec4.hpp"
+
+#include "../support/error.hpp"
+
 SimpleMeshData concatenate(SimpleMeshData aM, SimpleMeshData const& aN)
 {
 	aM.positions.insert(aM.positions.end(), aN.positions.begin(), aN.positions.end());
 	aM.colors.insert(aM.colors.end(), aN.colors.begin(), aN.colors.end());
 	aM.normals.insert(aM.normals.end(), aN.normals.begin(), aN.normals.end());
+	aM.texcoords.insert(aM.texcoords.end(), aN.texcoords.begin(), aN.texcoords.end());
+
+	// Material IDs of the second mesh index into its own materials, which are
+	// appended after the first mesh's.
+	if (!aM.materialIds.empty() || !aN.materialIds.empty())
+	{
+		auto const base = std::uint32_t(aM.materials.size());
+		aM.materialIds.reserve(aM.positions.size());
+		for (auto const id : aN.materialIds)
+			aM.materialIds.emplace_back(base + id);
+		aM.materials.insert(aM.materials.end(), aN.materials.begin(), aN.materials.end());
+
+		if (aM.materialIds.size() != aM.positions.size())
+			throw Error("concatenate(): cannot mix meshes with and without materials");
+	}
+
+	return aM;
+}
+
+SimpleMeshData transform(SimpleMeshData aM, Mat44f const& aModel2World)
+{
+	auto const normalMatrix = transpose(invert(aModel2World));
+
+	for (auto& p : aM.positions)
+	{
+		auto const t = aModel2World * Vec4f{ p.x, p.y, p.z, 1.f };
+		p = Vec3f{ t.x, t.y, t.z } / t.w;
+	}
+	for (auto& n : aM.normals)
+	{
+		auto const t = normalMatrix * Vec4f{ n.x, n.y, n.z, 0.f };
+		n = normalize(Vec3f{ t.x, t.y, t.z });
+	}
+
 	return aM;
 }
 
@@ -13,8 +51,9 @@ GLuint create_vao(SimpleMeshData const& aMeshData)
 {
     // 
     if (aMeshData.positions.size() != aMeshData.colors.size() ||
-        aMeshData.positions.size() != aMeshData.normals.size()) {
-        throw printf("Mesh data arrays have inconsistent sizes!");
+        aMeshData.positions.size() != aMeshData.normals.size() ||
+        (!aMeshData.materialIds.empty() && aMeshData.positions.size() != aMeshData.materialIds.size())) {
+        throw Error("Mesh data arrays have inconsistent sizes!");
     }
 
     // λ VBO
@@ -40,6 +79,13 @@ GLuint create_vao(SimpleMeshData const& aMeshData)
     glBindBuffer(GL_ARRAY_BUFFER, texCoordVBO);
     glBufferData(GL_ARRAY_BUFFER, aMeshData.texcoords.size() * sizeof(Vec2f), aMeshData.texcoords.data(), GL_STATIC_DRAW);
 
+    GLuint materialVBO = 0;
+    if (!aMeshData.materialIds.empty())
+    {
+        glGenBuffers(1, &materialVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+        glBufferData(GL_ARRAY_BUFFER, aMeshData.materialIds.size() * sizeof(std::uint32_t), aMeshData.materialIds.data(), GL_STATIC_DRAW);
+    }
 
     //  VAO
     GLuint vao = 0;
@@ -65,6 +111,14 @@ GLuint create_vao(SimpleMeshData const& aMeshData)
     glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 0, 0);
     glEnableVertexAttribArray(3);
 
+    // Material ID; integer attribute, so it is not converted to float.
+    if (materialVBO)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, materialVBO);
+        glVertexAttribIPointer(4, 1, GL_UNSIGNED_INT, 0, 0);
+        glEnableVertexAttribArray(4);
+    }
+
     //  VAO  VBO
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
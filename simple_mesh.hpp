@@ -3,10 +3,21 @@
 
 #include <glad/glad.h>
 
+#include <string>
 #include <vector>
 
+#include <cstdint>
+
 #include "../vmlib/vec3.hpp"
 #include "../vmlib/vec2.hpp"
+#include "../vmlib/mat44.hpp"
+
+struct SimpleMaterial
+{
+	std::string name;
+	Vec3f diffuse;
+	std::string diffuseTexture; // resolved path; empty if untextured
+};
 
 struct SimpleMeshData
 {
@@ -14,10 +25,18 @@ struct SimpleMeshData
 	std::vector<Vec3f> colors;
 	std::vector<Vec3f> normals;
 	std::vector<Vec2f> texcoords;
+
+	// Per-vertex index into materials. Empty if the mesh has no materials.
+	std::vector<std::uint32_t> materialIds;
+	std::vector<SimpleMaterial> materials;
 };
 
 SimpleMeshData concatenate(SimpleMeshData, SimpleMeshData const&);
 
+// Bakes a model-to-world transform into the positions and normals, so that
+// meshes with different transforms can share a single draw.
+SimpleMeshData transform(SimpleMeshData, Mat44f const& aModel2World);
+
 
 GLuint create_vao(SimpleMeshData const&);
 
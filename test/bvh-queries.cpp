@@ -0,0 +1,207 @@
+#include <catch2/catch_amalgamated.hpp>
+
+#include <numbers>
+#include <vector>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdint>
+
+#include "../../vmlib/vec3.hpp"
+
+#include "../bvh.hpp"
+#include "../simple_mesh.hpp"
+
+namespace
+{
+	// Bumpy grid of aSize x aSize quads with a few hundred small triangles
+	// scattered above it, so that rays hit both large coherent surfaces and
+	// isolated triangles.
+	SimpleMeshData make_scene_(std::size_t aSize)
+	{
+		auto const height = [] (std::size_t aX, std::size_t aZ) {
+			return 2.f * std::sin(0.3f * float(aX)) * std::cos(0.2f * float(aZ));
+		};
+
+		SimpleMeshData ret;
+		for (std::size_t z = 0; z < aSize; ++z)
+		{
+			for (std::size_t x = 0; x < aSize; ++x)
+			{
+				Vec3f const p00{ float(x), height(x, z), float(z) };
+				Vec3f const p10{ float(x + 1), height(x + 1, z), float(z) };
+				Vec3f const p01{ float(x), height(x, z + 1), float(z + 1) };
+				Vec3f const p11{ float(x + 1), height(x + 1, z + 1), float(z + 1) };
+				ret.positions.insert(ret.positions.end(), { p00, p01, p10, p10, p01, p11 });
+			}
+		}
+
+		std::uint32_t state = 12345u;
+		auto const next = [&state] {
+			state = state * 1664525u + 1013904223u;
+			return float(state >> 8) / float(1u << 24);
+		};
+
+		float const extent = float(aSize);
+		for (int i = 0; i < 300; ++i)
+		{
+			Vec3f const c{ next() * extent, 3.f + 5.f * next(), next() * extent };
+			for (int v = 0; v < 3; ++v)
+				ret.positions.emplace_back(c + Vec3f{ next() - 0.5f, next() - 0.5f, next() - 0.5f } * 2.f);
+		}
+
+		return ret;
+	}
+
+	// Primary rays of an aSize x aSize view from above and to the side of
+	// the mesh, looking at its centre, in 2x2 pixel packets.
+	std::vector<Ray> make_view_rays_(SimpleMeshData const& aMesh, int aSize)
+	{
+		Vec3f lo{ 1e30f, 1e30f, 1e30f }, hi = -lo;
+		for (auto const& p : aMesh.positions)
+		{
+			lo = { std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+			hi = { std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+		}
+
+		auto const centre = (lo + hi) * 0.5f;
+		float const extent = length(hi - lo);
+
+		auto const eye = centre + Vec3f{ 0.f, 0.3f * extent, -0.6f * extent };
+		auto const forward = normalize(centre - eye);
+		auto const right = normalize(cross(forward, Vec3f{ 0.f, 1.f, 0.f }));
+		auto const up = cross(right, forward);
+
+		float const halfFov = std::tan(30.f * std::numbers::pi_v<float> / 180.f);
+
+		std::vector<Ray> ret;
+		for (int y = 0; y < aSize; y += 2)
+		{
+			for (int x = 0; x < aSize; x += 2)
+			{
+				for (int i = 0; i < 4; ++i)
+				{
+					float const sx = (2.f * (float(x + i % 2) + 0.5f) / float(aSize) - 1.f) * halfFov;
+					float const sy = (1.f - 2.f * (float(y + i / 2) + 0.5f) / float(aSize)) * halfFov;
+					ret.emplace_back(Ray{ eye, forward + right * sx + up * sy });
+				}
+			}
+		}
+
+		return ret;
+	}
+
+	// Reference: every triangle, same test as the BVH leaves.
+	RayHit intersect_brute_force_(SimpleMeshData const& aMesh, Ray const& aRay)
+	{
+		RayHit ret;
+		ret.t = aRay.tMax;
+
+		for (std::size_t i = 0; i + 2 < aMesh.positions.size(); i += 3)
+		{
+			auto const& p0 = aMesh.positions[i];
+			auto const e1 = aMesh.positions[i + 1] - p0;
+			auto const e2 = aMesh.positions[i + 2] - p0;
+
+			auto const p = cross(aRay.direction, e2);
+			float const det = dot(e1, p);
+			if (std::abs(det) <= 1e-12f)
+				continue;
+
+			float const invDet = 1.f / det;
+			auto const tv = aRay.origin - p0;
+			float const u = dot(tv, p) * invDet;
+			auto const q = cross(tv, e1);
+			float const v = dot(aRay.direction, q) * invDet;
+			float const t = dot(e2, q) * invDet;
+			if (u >= 0.f && v >= 0.f && u + v <= 1.f && t > 0.f && t < ret.t)
+				ret = RayHit{ t, std::uint32_t(i / 3), u, v };
+		}
+
+		return ret.triangle == kNoHit ? RayHit{} : ret;
+	}
+
+	// Hits on a shared edge may report either triangle; the distance must
+	// agree regardless.
+	bool same_hit_(RayHit const& aA, RayHit const& aB)
+	{
+		if (bool(aA) != bool(aB))
+			return false;
+		if (!aA)
+			return true;
+		return aA.triangle == aB.triangle || std::abs(aA.t - aB.t) <= 1e-4f * std::max(1.f, aA.t);
+	}
+}
+
+TEST_CASE( "BVH queries agree with brute force", "[bvh]" )
+{
+	auto const mesh = make_scene_(64);
+	auto const rays = make_view_rays_(mesh, 128);
+
+	// A low threshold builds large parts of the tree in parallel.
+	BvhBuildOptions opts;
+	SECTION( "serial build" ) { opts.threads = 1; }
+	SECTION( "parallel build" ) { opts.parallelThreshold = 256; opts.threads = 8; }
+
+	TriangleBvh const bvh(mesh, opts);
+	REQUIRE( bvh.triangle_count() == mesh.positions.size() / 3 );
+
+	std::size_t hits = 0, packetMismatches = 0, referenceMismatches = 0;
+	for (std::size_t i = 0; i < rays.size(); i += 4)
+	{
+		Ray const packet[4] = { rays[i], rays[i + 1], rays[i + 2], rays[i + 3] };
+		RayHit packetHits[4];
+		bvh.intersect4(packet, packetHits);
+
+		for (std::size_t j = 0; j < 4; ++j)
+		{
+			auto const single = bvh.intersect(packet[j]);
+			auto const ref = intersect_brute_force_(mesh, packet[j]);
+
+			packetMismatches += !same_hit_(single, packetHits[j]);
+			referenceMismatches += !same_hit_(single, ref);
+			hits += bool(single);
+		}
+	}
+
+	// A good part of the view is covered by the mesh.
+	CHECK( hits > rays.size() / 4 );
+	CHECK( 0 == packetMismatches );
+	CHECK( 0 == referenceMismatches );
+}
+
+TEST_CASE( "BVH of an empty mesh", "[bvh]" )
+{
+	TriangleBvh const bvh{ SimpleMeshData{} };
+	CHECK( 0 == bvh.node_count() );
+	CHECK( !bvh.intersect(Ray{ { 0.f, 0.f, 0.f }, { 0.f, 0.f, 1.f } }) );
+}
+
+TEST_CASE( "BVH rays with an origin on a node plane", "[bvh]" )
+{
+	// Floor over [-1,1]^2 at y = 0. The rays run parallel to the x = -1 face
+	// of the root box, inside it; they hit the floor on its edge.
+	SimpleMeshData mesh;
+	mesh.positions = {
+		{ -1.f, 0.f, -1.f }, { 1.f, 0.f, -1.f }, { -1.f, 0.f, 1.f },
+		{ 1.f, 0.f, -1.f }, { 1.f, 0.f, 1.f }, { -1.f, 0.f, 1.f }
+	};
+
+	TriangleBvh const bvh(mesh);
+
+	auto const down = GENERATE( 0.f, -0.f );
+	Ray const ray{ { -1.f, 4.f, 0.f }, { down, -1.f, down } };
+
+	auto const single = bvh.intersect(ray);
+	REQUIRE( single );
+	CHECK( single.t == 4.f );
+
+	Ray const packet[4] = { ray, ray, ray, ray };
+	RayHit hits[4];
+	bvh.intersect4(packet, hits);
+	for (auto const& hit : hits)
+	{
+		REQUIRE( hit );
+		CHECK( hit.t == 4.f );
+	}
+}
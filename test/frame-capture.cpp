@@ -0,0 +1,153 @@
+#include <catch2/catch_amalgamated.hpp>
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include "stb_image.h"
+
+#include "../capture.hpp"
+
+#include "gl_context.hpp"
+
+namespace
+{
+	struct Image_
+	{
+		int width = 0, height = 0;
+		std::vector<unsigned char> rgb;  // top row first
+	};
+
+	Image_ read_ppm_(std::filesystem::path const& aPath)
+	{
+		Image_ ret;
+
+		std::FILE* file = std::fopen(aPath.string().c_str(), "rb");
+		if (!file)
+			return ret;
+
+		int maxValue = 0;
+		if (3 == std::fscanf(file, "P6 %d %d %d", &ret.width, &ret.height, &maxValue) && 255 == maxValue && '\n' == std::fgetc(file))
+		{
+			ret.rgb.resize(std::size_t(ret.width) * std::size_t(ret.height) * 3);
+			if (ret.rgb.size() != std::fread(ret.rgb.data(), 1, ret.rgb.size(), file))
+				ret.rgb.clear();
+		}
+
+		std::fclose(file);
+		return ret;
+	}
+
+	Image_ read_png_(std::filesystem::path const& aPath)
+	{
+		Image_ ret;
+
+		// texture.cpp turns flipping on for GL uploads; here, the top row
+		// must come first, as in the file.
+		stbi_set_flip_vertically_on_load(false);
+
+		int channels = 0;
+		unsigned char* pixels = stbi_load(aPath.string().c_str(), &ret.width, &ret.height, &channels, 3);
+		if (pixels)
+		{
+			ret.rgb.assign(pixels, pixels + std::size_t(ret.width) * std::size_t(ret.height) * 3);
+			stbi_image_free(pixels);
+		}
+
+		return ret;
+	}
+}
+
+TEST_CASE( "Captured frames match what was rendered", "[capture][gl]" )
+{
+	if (!has_test_gl_context())
+		SKIP( test_gl_context_error() );
+
+	auto const format = GENERATE( CaptureFormat::raw, CaptureFormat::png );
+	auto const path = std::filesystem::temp_directory_path() / (CaptureFormat::raw == format ? "frame-capture-test.ppm" : "frame-capture-test.png");
+
+	// Not square and not a multiple of four wide, so that swapped dimensions
+	// or row padding show up.
+	constexpr GLsizei kWidth = 61, kHeight = 34;
+
+	// Quadrants in linear colour, as the shaders output them. The window's
+	// framebuffer is sRGB with GL_FRAMEBUFFER_SRGB enabled (see main.cpp), so
+	// they are stored sRGB-encoded, and that is what a capture must contain:
+	// linear 0.5 is 188, not 128. Top and bottom differ, and so do left and
+	// right, so that a flipped or mirrored image does not match.
+	struct Quadrant_ { bool top, left; float linear[3]; unsigned char srgb[3]; };
+	constexpr Quadrant_ kQuadrants[] = {
+		{ true, true, { 1.f, 0.f, 0.f }, { 255, 0, 0 } },
+		{ true, false, { 0.f, 1.f, 0.f }, { 0, 255, 0 } },
+		{ false, true, { 0.f, 0.f, 1.f }, { 0, 0, 255 } },
+		{ false, false, { 0.5f, 0.5f, 0.5f }, { 188, 188, 188 } }
+	};
+
+	GLuint tex = 0, fbo = 0;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_SRGB8_ALPHA8, kWidth, kHeight);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+	REQUIRE( GL_FRAMEBUFFER_COMPLETE == glCheckFramebufferStatus(GL_FRAMEBUFFER) );
+
+	// Scissored clears (converted to sRGB like any other write) paint the
+	// quadrants; GL's origin is the bottom left.
+	glEnable(GL_FRAMEBUFFER_SRGB);
+	glEnable(GL_SCISSOR_TEST);
+	for (auto const& q : kQuadrants)
+	{
+		GLint const x = q.left ? 0 : kWidth / 2, y = q.top ? kHeight / 2 : 0;
+		glScissor(x, y, q.left ? kWidth / 2 : kWidth - x, q.top ? kHeight - y : kHeight / 2);
+		glClearColor(q.linear[0], q.linear[1], q.linear[2], 1.f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+	glDisable(GL_SCISSOR_TEST);
+	glDisable(GL_FRAMEBUFFER_SRGB);
+
+	std::filesystem::remove(path);
+
+	CaptureStats stats;
+	{
+		FrameCapture capture(false, 1);
+		capture.capture(kWidth, kHeight, path.string(), format);
+		capture.flush();
+		stats = capture.stats();
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteTextures(1, &tex);
+
+	REQUIRE( 1 == stats.written );
+
+	auto const image = CaptureFormat::raw == format ? read_ppm_(path) : read_png_(path);
+	std::filesystem::remove(path);
+
+	REQUIRE( kWidth == image.width );
+	REQUIRE( kHeight == image.height );
+	REQUIRE( !image.rgb.empty() );
+
+	// Row 0 of the file is the top of the image.
+	std::size_t mismatches = 0;
+	for (int y = 0; y < kHeight; ++y)
+	{
+		bool const top = y < kHeight - kHeight / 2;
+		for (int x = 0; x < kWidth; ++x)
+		{
+			bool const left = x < kWidth / 2;
+			auto const& q = kQuadrants[(top ? 0 : 2) + (left ? 0 : 1)];
+
+			auto const* px = image.rgb.data() + (std::size_t(y) * std::size_t(kWidth) + std::size_t(x)) * 3;
+			for (int c = 0; c < 3; ++c)
+				mismatches += std::abs(int(px[c]) - int(q.srgb[c])) > 1;
+		}
+	}
+
+	CHECK( 0 == mismatches );
+}
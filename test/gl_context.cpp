@@ -0,0 +1,105 @@
+#include "gl_context.hpp"
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <memory>
+#include <string>
+#include <exception>
+
+#include "../../support/error.hpp"
+
+namespace
+{
+	struct GLContext_
+	{
+		GLContext_();
+		~GLContext_();
+
+		GLContext_(GLContext_ const&) = delete;
+		GLContext_& operator=(GLContext_ const&) = delete;
+
+		GLFWwindow* window = nullptr;
+	};
+
+	struct State_
+	{
+		bool tried = false;
+		std::unique_ptr<GLContext_> context;
+		std::string error;
+	};
+
+	State_& state_()
+	{
+		static State_ state;
+		return state;
+	}
+}
+
+bool has_test_gl_context()
+{
+	auto& state = state_();
+	if (!state.tried)
+	{
+		state.tried = true;
+		try
+		{
+			state.context = std::make_unique<GLContext_>();
+		}
+		catch (std::exception const& eErr)
+		{
+			state.error = eErr.what();
+		}
+	}
+
+	return !!state.context;
+}
+
+char const* test_gl_context_error()
+{
+	return state_().error.c_str();
+}
+
+namespace
+{
+	GLContext_::GLContext_()
+	{
+		if (GLFW_TRUE != glfwInit())
+		{
+			char const* msg = nullptr;
+			int ecode = glfwGetError(&msg);
+			throw Error("glfwInit() failed with '%s' (%d)", msg, ecode);
+		}
+
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GLFW_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		window = glfwCreateWindow(64, 64, "test", nullptr, nullptr);
+		if (!window)
+		{
+			char const* msg = nullptr;
+			int ecode = glfwGetError(&msg);
+			glfwTerminate();
+			throw Error("glfwCreateWindow() failed with '%s' (%d)", msg, ecode);
+		}
+
+		glfwMakeContextCurrent(window);
+		glfwSwapInterval(0);
+
+		if (!gladLoadGLLoader((GLADloadproc)&glfwGetProcAddress))
+		{
+			glfwDestroyWindow(window);
+			glfwTerminate();
+			throw Error("gladLoaDGLLoader() failed - cannot load GL API!");
+		}
+	}
+
+	GLContext_::~GLContext_()
+	{
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	}
+}
@@ -0,0 +1,19 @@
+#ifndef GL_CONTEXT_HPP_5D0B7E21_64C3_4F8A_9B1E_7A2C3D4E5F60
+#define GL_CONTEXT_HPP_5D0B7E21_64C3_4F8A_9B1E_7A2C3D4E5F60
+
+/* OpenGL context for the tests that need one.
+ *
+ * The first call to has_test_gl_context() creates a hidden window with a GL
+ * 4.3 core context and makes it current; it is shared by all tests and lives
+ * until the process exits. If no context can be created, it returns false
+ * (test_gl_context_error() says why), and the tests that need one are
+ * skipped. To run them on a machine without a GPU, force Mesa's software
+ * rasterizer (LIBGL_ALWAYS_SOFTWARE=1, llvmpipe).
+ *
+ * The shaders are loaded from assets/cw2/, so run the tests from the
+ * directory that contains assets/.
+ */
+bool has_test_gl_context();
+char const* test_gl_context_error();
+
+#endif // GL_CONTEXT_HPP_5D0B7E21_64C3_4F8A_9B1E_7A2C3D4E5F60
@@ -0,0 +1,10 @@
+#include <catch2/catch_amalgamated.hpp>
+
+/* Correctness tests for the renderer's subsystems. Timing lives in the
+ * benchmarks (bench/); the tests here only check results.
+ */
+
+int main(int aArgc, char* aArgv[])
+{
+	return Catch::Session().run(aArgc, aArgv);
+}
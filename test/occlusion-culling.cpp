@@ -0,0 +1,194 @@
+#include <catch2/catch_amalgamated.hpp>
+
+#include <numbers>
+#include <vector>
+#include <algorithm>
+
+#include <cmath>
+#include <cstdint>
+
+#include "../../vmlib/vec3.hpp"
+#include "../../vmlib/mat44.hpp"
+
+#include "../bvh.hpp"
+#include "../occlusion.hpp"
+#include "../simple_mesh.hpp"
+
+namespace
+{
+	bool same_(Vec3f const& aA, Vec3f const& aB)
+	{
+		return aA.x == aB.x && aA.y == aB.y && aA.z == aB.z;
+	}
+
+	// Rolling hills with a ridge across the middle (as in the benchmark), so
+	// that a viewer near the ground has a good part of the mesh hidden.
+	SimpleMeshData make_hills_(std::size_t aSize)
+	{
+		auto const height = [] (std::size_t aX, std::size_t aZ) {
+			float const x = float(aX), z = float(aZ);
+			float const ridge = 12.f * std::exp(-0.02f * (z - 64.f) * (z - 64.f));
+			return 6.f * std::sin(0.05f * x) * std::cos(0.07f * z) + ridge;
+		};
+
+		SimpleMeshData ret;
+		for (std::size_t z = 0; z < aSize; ++z)
+		{
+			for (std::size_t x = 0; x < aSize; ++x)
+			{
+				Vec3f const p00{ float(x), height(x, z), float(z) };
+				Vec3f const p10{ float(x + 1), height(x + 1, z), float(z) };
+				Vec3f const p01{ float(x), height(x, z + 1), float(z + 1) };
+				Vec3f const p11{ float(x + 1), height(x + 1, z + 1), float(z + 1) };
+				ret.positions.insert(ret.positions.end(), { p00, p01, p10, p10, p01, p11 });
+			}
+		}
+
+		return ret;
+	}
+
+	// Views from just above the ground, on a ring around the centre,
+	// looking in all directions.
+	std::vector<Mat44f> make_ground_views_(SimpleMeshData const& aMesh, int aCount)
+	{
+		TriangleBvh const bvh(aMesh);
+
+		Vec3f lo{ 1e30f, 1e30f, 1e30f }, hi = -lo;
+		for (auto const& p : aMesh.positions)
+		{
+			lo = { std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+			hi = { std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+		}
+
+		auto const centre = (lo + hi) * 0.5f;
+		float const radius = 0.3f * std::min(hi.x - lo.x, hi.z - lo.z);
+
+		auto const projection = make_perspective_projection(60.f * std::numbers::pi_v<float> / 180.f, 16.f / 9.f, 0.1f, 1000.f);
+
+		std::vector<Mat44f> ret;
+		for (int i = 0; i < aCount; ++i)
+		{
+			float const angle = 2.f * std::numbers::pi_v<float> * float(i) / float(aCount);
+			Vec3f eye{ centre.x + radius * std::cos(angle), hi.y + 1.f, centre.z + radius * std::sin(angle) };
+			if (auto const hit = bvh.intersect(Ray{ eye, { 0.f, -1.f, 0.f } }))
+				eye.y -= hit.t;
+			eye.y += 1.5f;
+
+			float const yaw = 2.39996f * float(i); // golden angle
+			ret.emplace_back(projection * make_rotation_x(0.1f) * make_rotation_y(yaw) * make_translation(-eye));
+		}
+
+		return ret;
+	}
+}
+
+TEST_CASE( "make_draw_chunks permutes whole triangles", "[occlusion]" )
+{
+	constexpr GLint kFirst = 300;
+
+	// Tag each vertex with its triangle and corner, in every attribute.
+	auto mesh = make_hills_(24);
+	auto const triangles = mesh.positions.size() / 3;
+	for (std::size_t v = 0; v < mesh.positions.size(); ++v)
+	{
+		float const tri = float(v / 3), corner = float(v % 3);
+		mesh.colors.push_back({ tri, corner, 0.f });
+		mesh.normals.push_back({ 0.f, tri, corner });
+		mesh.texcoords.push_back({ tri, corner });
+		mesh.materialIds.push_back(std::uint32_t(v));
+	}
+
+	auto const original = mesh;
+	auto const chunks = make_draw_chunks(mesh, 4, kFirst);
+
+	REQUIRE( !chunks.empty() );
+	REQUIRE( mesh.positions.size() == original.positions.size() );
+	REQUIRE( mesh.colors.size() == original.colors.size() );
+	REQUIRE( mesh.normals.size() == original.normals.size() );
+	REQUIRE( mesh.texcoords.size() == original.texcoords.size() );
+	REQUIRE( mesh.materialIds.size() == original.materialIds.size() );
+
+	// Chunks tile the vertex range without gaps, in whole triangles.
+	GLint next = kFirst;
+	for (auto const& chunk : chunks)
+	{
+		CHECK( chunk.first == next );
+		CHECK( chunk.count > 0 );
+		CHECK( 0 == chunk.count % 3 );
+		next = chunk.first + chunk.count;
+	}
+	CHECK( next == kFirst + GLint(mesh.positions.size()) );
+
+	// Every triangle appears exactly once, its vertices in order and with
+	// all of their attributes.
+	std::vector<int> seen(triangles, 0);
+	std::size_t broken = 0;
+	for (std::size_t v = 0; v < mesh.positions.size(); ++v)
+	{
+		auto const tri = std::size_t(mesh.colors[v].x);
+		auto const from = tri * 3 + v % 3;
+		if (0 == v % 3)
+			++seen[tri];
+
+		broken += mesh.colors[v].y != float(v % 3)
+			|| !same_(mesh.positions[v], original.positions[from])
+			|| !same_(mesh.normals[v], original.normals[from])
+			|| mesh.texcoords[v].x != original.texcoords[from].x
+			|| mesh.texcoords[v].y != original.texcoords[from].y
+			|| mesh.materialIds[v] != original.materialIds[from];
+	}
+	CHECK( 0 == broken );
+	CHECK( std::all_of(seen.begin(), seen.end(), [] (int aN) { return 1 == aN; }) );
+
+	// Bounds are exactly those of the chunk's vertices.
+	for (auto const& chunk : chunks)
+	{
+		Vec3f lo{ 1e30f, 1e30f, 1e30f }, hi = -lo;
+		for (GLint v = chunk.first - kFirst; v < chunk.first - kFirst + chunk.count; ++v)
+		{
+			auto const& p = mesh.positions[std::size_t(v)];
+			lo = { std::min(lo.x, p.x), std::min(lo.y, p.y), std::min(lo.z, p.z) };
+			hi = { std::max(hi.x, p.x), std::max(hi.y, p.y), std::max(hi.z, p.z) };
+		}
+		CHECK( same_(chunk.boundsMin, lo) );
+		CHECK( same_(chunk.boundsMax, hi) );
+	}
+}
+
+TEST_CASE( "AVX2 and scalar occlusion rasterizers agree", "[occlusion]" )
+{
+	auto mesh = make_hills_(128);
+	auto const chunks = make_draw_chunks(mesh, 16);
+	auto const occluder = make_heightfield_occluder(mesh, 64);
+	auto const views = make_ground_views_(mesh, 32);
+
+	OcclusionCuller avx2(occluder, { 320, 180, 0, true });
+	OcclusionCuller scalar(occluder, { 320, 180, 0, false });
+	REQUIRE( !scalar.uses_avx2() );
+	if (!avx2.uses_avx2())
+		SKIP( "CPU does not support AVX2" );
+
+	std::vector<GLint> firstsA, firstsS;
+	std::vector<GLsizei> countsA, countsS;
+	std::size_t depthMismatches = 0, visibilityMismatches = 0;
+	for (auto const& view : views)
+	{
+		avx2.begin(view);
+		avx2.cull(chunks, firstsA, countsA);
+		scalar.begin(view);
+		scalar.cull(chunks, firstsS, countsS);
+
+		auto const da = avx2.depth_buffer(), ds = scalar.depth_buffer();
+		REQUIRE( da.size() == ds.size() );
+		depthMismatches += !std::equal(da.begin(), da.end(), ds.begin());
+		visibilityMismatches += firstsA != firstsS || countsA != countsS;
+	}
+
+	CHECK( 0 == depthMismatches );
+	CHECK( 0 == visibilityMismatches );
+
+	// The views must actually exercise the occluders.
+	auto const stats = scalar.report();
+	CHECK( stats.occluded > 0 );
+	CHECK( stats.occluded + stats.outside < stats.candidates );
+}
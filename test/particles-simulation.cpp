@@ -0,0 +1,81 @@
+#include <catch2/catch_amalgamated.hpp>
+
+#include "../particles.hpp"
+
+#include "gl_context.hpp"
+
+namespace
+{
+	// Exhaust-like emitter, as in the benchmark.
+	constexpr ParticleEmitter kEmitter_{
+		{ 0.f, 0.f, 0.f },
+		{ 0.f, -4.f, 0.f },
+		0.35f, 0.2f, 0.1f,
+		0.5f, 2.f,
+		20000.f
+	};
+	constexpr ParticleForces kForces_{ { 0.f, 1.5f, 0.f }, 0.8f };
+
+	constexpr float kDt_ = 1.f / 60.f;
+}
+
+TEST_CASE( "Particle emission carries fractional spawns over", "[particles]" )
+{
+	auto emitter = kEmitter_;
+	emitter.rate = 50.f;
+
+	std::vector<float> accumulators;
+	ParticleEmitterGpu out[kMaxParticleEmitters];
+
+	std::uint32_t total = 0;
+	for (int i = 0; i < 60; ++i)
+		total += plan_particle_emission(kDt_, { &emitter, 1 }, accumulators, out);
+
+	// One second at 50/s; float accumulation may leave the last one pending.
+	CHECK( total >= 49 );
+	CHECK( total <= 50 );
+}
+
+TEST_CASE( "GPU particle simulation matches the CPU reference", "[particles][gl]" )
+{
+	if (!has_test_gl_context())
+		SKIP( test_gl_context_error() );
+
+	// Stay below the capacity, since which spawns are dropped at the limit
+	// depends on the order of the atomics on the GPU.
+	constexpr std::size_t kCapacity = 1 << 16;
+
+	ParticleSystem gpu(kCapacity);
+	ParticleSystemCpu cpu(kCapacity);
+	for (int i = 0; i < 120; ++i)
+	{
+		gpu.update(kDt_, { &kEmitter_, 1 }, kForces_);
+		cpu.update(kDt_, { &kEmitter_, 1 }, kForces_);
+	}
+
+	auto const gpuParticles = gpu.read_back();
+	auto const a = summarize_particles(gpuParticles);
+	auto const b = summarize_particles(cpu.particles());
+
+	INFO( "gpu: " << a.count << " particles, mean pos (" << a.meanPosition.x << ", " << a.meanPosition.y << ", " << a.meanPosition.z << "), mean age " << a.meanAge );
+	INFO( "cpu: " << b.count << " particles, mean pos (" << b.meanPosition.x << ", " << b.meanPosition.y << ", " << b.meanPosition.z << "), mean age " << b.meanAge );
+	CHECK( b.count > kCapacity / 4 );
+	CHECK( particle_summaries_match(a, b, 5e-3f) );
+}
+
+TEST_CASE( "GPU particle system stays within its capacity", "[particles][gl]" )
+{
+	if (!has_test_gl_context())
+		SKIP( test_gl_context_error() );
+
+	constexpr std::size_t kCapacity = 1000;
+
+	auto emitter = kEmitter_;
+	emitter.lifeMin = emitter.lifeMax = 10.f;
+
+	ParticleSystem gpu(kCapacity);
+	for (int i = 0; i < 10; ++i)
+		gpu.update(kDt_, { &emitter, 1 }, kForces_);
+
+	CHECK( gpu.read_back().size() == kCapacity );
+}
@@ -0,0 +1,139 @@
+#include "texture.hpp"
+
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+
+#include "stb_image.h"
+
+#include "../support/error.hpp"
+
+namespace
+{
+	struct ImageDeleter_
+	{
+		void operator()(unsigned char* aData) const noexcept { stbi_image_free(aData); }
+	};
+
+	struct Image_
+	{
+		int width, height;
+		std::unique_ptr<unsigned char, ImageDeleter_> data; // RGBA8
+	};
+
+	// Bilinear resampling of an RGBA8 image.
+	std::vector<unsigned char> resample_(Image_ const& aSrc, int aWidth, int aHeight)
+	{
+		std::vector<unsigned char> ret(std::size_t(aWidth) * std::size_t(aHeight) * 4);
+
+		auto const* src = aSrc.data.get();
+		auto const texel = [&] (int aX, int aY, int aC) {
+			return float(src[(std::size_t(aY) * std::size_t(aSrc.width) + std::size_t(aX)) * 4 + std::size_t(aC)]);
+		};
+
+		for (int y = 0; y < aHeight; ++y)
+		{
+			float const sy = std::clamp((float(y) + 0.5f) * float(aSrc.height) / float(aHeight) - 0.5f, 0.f, float(aSrc.height - 1));
+			int const y0 = int(sy), y1 = std::min(y0 + 1, aSrc.height - 1);
+			float const fy = sy - float(y0);
+
+			for (int x = 0; x < aWidth; ++x)
+			{
+				float const sx = std::clamp((float(x) + 0.5f) * float(aSrc.width) / float(aWidth) - 0.5f, 0.f, float(aSrc.width - 1));
+				int const x0 = int(sx), x1 = std::min(x0 + 1, aSrc.width - 1);
+				float const fx = sx - float(x0);
+
+				for (int c = 0; c < 4; ++c)
+				{
+					float const top = texel(x0, y0, c) * (1.f - fx) + texel(x1, y0, c) * fx;
+					float const bot = texel(x0, y1, c) * (1.f - fx) + texel(x1, y1, c) * fx;
+					ret[(std::size_t(y) * std::size_t(aWidth) + std::size_t(x)) * 4 + std::size_t(c)]
+						= (unsigned char)(top * (1.f - fy) + bot * fy + 0.5f);
+				}
+			}
+		}
+
+		return ret;
+	}
+}
+
+GLuint load_texture_2d(char const* aPath)
+{
+	stbi_set_flip_vertically_on_load(true);
+
+	int width, height, channels;
+	unsigned char* data = stbi_load(aPath, &width, &height, &channels, 4);
+	if (!data) {
+		throw std::runtime_error("Failed to load texture");
+	}
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	stbi_image_free(data);
+	return texture;
+}
+
+GLuint load_texture_2d_array(std::vector<std::string> const& aPaths)
+{
+	if (aPaths.empty())
+		throw Error("load_texture_2d_array(): no images");
+
+	stbi_set_flip_vertically_on_load(true);
+
+	std::vector<Image_> images;
+	int width = 0, height = 0;
+	for (auto const& path : aPaths)
+	{
+		Image_ image{};
+		int channels;
+		image.data.reset(stbi_load(path.c_str(), &image.width, &image.height, &channels, 4));
+		if (!image.data)
+			throw Error("Failed to load texture '%s': %s", path.c_str(), stbi_failure_reason());
+
+		width = std::max(width, image.width);
+		height = std::max(height, image.height);
+		images.emplace_back(std::move(image));
+	}
+
+	GLsizei levels = 1;
+	for (int size = std::max(width, height); size > 1; size /= 2)
+		++levels;
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, GL_RGBA8, width, height, GLsizei(images.size()));
+
+	for (std::size_t i = 0; i < images.size(); ++i)
+	{
+		auto const& image = images[i];
+		if (image.width == width && image.height == height)
+		{
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(i), width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.data.get());
+		}
+		else
+		{
+			auto const resampled = resample_(image, width, height);
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, GLint(i), width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, resampled.data());
+		}
+	}
+
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	return texture;
+}
@@ -0,0 +1,16 @@
+#ifndef TEXTURE_HPP_E8F4F40C_A9AE_43FA_A3D6_ABCC3103367F
+#define TEXTURE_HPP_E8F4F40C_A9AE_43FA_A3D6_ABCC3103367F
+
+#include <glad/glad.h>
+
+#include <string>
+#include <vector>
+
+GLuint load_texture_2d(char const* aPath);
+
+// Loads the images into the layers of a GL_TEXTURE_2D_ARRAY, in order. All
+// layers of an array texture share one size; images of a different size are
+// resampled to the largest width and height among them.
+GLuint load_texture_2d_array(std::vector<std::string> const& aPaths);
+
+#endif // TEXTURE_HPP_E8F4F40C_A9AE_43FA_A3D6_ABCC3103367F
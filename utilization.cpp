@@ -0,0 +1,139 @@
+#include "utilization.hpp"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#	define WIN32_LEAN_AND_MEAN
+#	define NOMINMAX
+#	include <windows.h>
+#else
+#	include <sys/resource.h>
+#endif
+
+double UtilizationSample::cpu_percent() const noexcept
+{
+	return seconds > 0. ? 100. * cpuSeconds / seconds : 0.;
+}
+double UtilizationSample::gpu_percent() const noexcept
+{
+	return seconds > 0. ? 100. * gpuSeconds / seconds : 0.;
+}
+
+double process_cpu_seconds()
+{
+#	if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0.;
+
+	auto const ticks = [] (FILETIME const& aTime) {
+		return (ULONGLONG(aTime.dwHighDateTime) << 32) | aTime.dwLowDateTime;
+	};
+	return double(ticks(kernel) + ticks(user)) * 1e-7; // 100 ns units
+#	else
+	rusage usage{};
+	if (0 != getrusage(RUSAGE_SELF, &usage))
+		return 0.;
+
+	auto const seconds = [] (timeval const& aTime) {
+		return double(aTime.tv_sec) + double(aTime.tv_usec) * 1e-6;
+	};
+	return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+#	endif
+}
+
+UtilizationMonitor::UtilizationMonitor(std::size_t aQueries)
+	: mQueries(aQueries)
+{
+	for (auto& query : mQueries)
+		glGenQueries(1, &query.id);
+}
+
+UtilizationMonitor::~UtilizationMonitor()
+{
+	for (auto& query : mQueries)
+		glDeleteQueries(1, &query.id);
+}
+
+void UtilizationMonitor::begin_gpu_frame(LoopState aState)
+{
+	collect_();
+
+	++sample_(aState).frames;
+
+	auto& query = mQueries[mNext];
+	if (query.pending)
+		return; // all in flight; skip timing this frame
+
+	glBeginQuery(GL_TIME_ELAPSED, query.id);
+	query.state = aState;
+	query.begun = std::chrono::steady_clock::now();
+	mCurrent = &query;
+}
+
+void UtilizationMonitor::end_gpu_frame()
+{
+	if (!mCurrent)
+		return;
+
+	glEndQuery(GL_TIME_ELAPSED);
+	mCurrent->pending = true;
+	mCurrent = nullptr;
+
+	mNext = (mNext + 1) % mQueries.size();
+}
+
+void UtilizationMonitor::update(double aNow, LoopState aState)
+{
+	double const cpu = process_cpu_seconds();
+
+	if (mLastWall >= 0.)
+	{
+		auto& sample = sample_(aState);
+		sample.seconds += aNow - mLastWall;
+		sample.cpuSeconds += cpu - mLastCpu;
+	}
+
+	mLastWall = aNow;
+	mLastCpu = cpu;
+}
+
+UtilizationReport UtilizationMonitor::report()
+{
+	collect_();
+
+	auto const ret = mTotals;
+	mTotals = UtilizationReport{};
+	return ret;
+}
+
+void UtilizationMonitor::collect_()
+{
+	// Oldest first; results become available in submission order.
+	for (std::size_t i = 0; i < mQueries.size(); ++i)
+	{
+		auto& query = mQueries[(mNext + i) % mQueries.size()];
+		if (!query.pending)
+			continue;
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &elapsed);
+
+		// Some drivers report garbage for the first query of a context. The
+		// GPU cannot have been busier than the wall time since the query
+		// began.
+		double const wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - query.begun).count();
+		sample_(query.state).gpuSeconds += std::min(double(elapsed) * 1e-9, wall);
+		query.pending = false;
+	}
+}
+
+UtilizationSample& UtilizationMonitor::sample_(LoopState aState) noexcept
+{
+	return LoopState::idle == aState ? mTotals.idle : mTotals.active;
+}
@@ -0,0 +1,93 @@
+#ifndef UTILIZATION_HPP_0993CB19_5FC7_4424_8EC6_C77249AB1D6A
+#define UTILIZATION_HPP_0993CB19_5FC7_4424_8EC6_C77249AB1D6A
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <vector>
+
+#include <cstddef>
+
+/* CPU and GPU utilisation of the render loop.
+ *
+ * CPU utilisation is the process' CPU time (all threads, user and system)
+ * over wall time; 100% is one fully busy core. GPU utilisation is the time
+ * spent on the GL commands between begin_gpu_frame() and end_gpu_frame(),
+ * measured with GL_TIME_ELAPSED queries, over wall time.
+ *
+ * Time is accounted separately for the active state (rendering new frames)
+ * and the idle state (waiting for events), as reported by the caller. Query
+ * results are collected once they are available; the monitor never waits for
+ * the GPU. A frame is not timed if all queries are still in flight.
+ */
+
+enum class LoopState
+{
+	active,
+	idle
+};
+
+struct UtilizationSample
+{
+	double seconds = 0.;     // wall time spent in the state
+	double cpuSeconds = 0.;
+	double gpuSeconds = 0.;
+	std::size_t frames = 0;  // frames rendered (GPU-timed or not)
+
+	double cpu_percent() const noexcept;
+	double gpu_percent() const noexcept;
+};
+
+struct UtilizationReport
+{
+	UtilizationSample active, idle;
+};
+
+// CPU time consumed by the process so far, in seconds.
+double process_cpu_seconds();
+
+class UtilizationMonitor
+{
+	public:
+		explicit UtilizationMonitor(std::size_t aQueries = 8);
+		~UtilizationMonitor();
+
+		UtilizationMonitor(UtilizationMonitor const&) = delete;
+		UtilizationMonitor& operator=(UtilizationMonitor const&) = delete;
+
+	public:
+		// Brackets the GL work of one frame. Must not be nested with other
+		// GL_TIME_ELAPSED queries.
+		void begin_gpu_frame(LoopState);
+		void end_gpu_frame();
+
+		// Accounts the wall and CPU time since the previous call to aState.
+		// Call once per loop iteration, with the state the iteration was in.
+		void update(double aNow, LoopState aState);
+
+		// Returns the totals since the previous report, and resets them.
+		UtilizationReport report();
+
+	private:
+		struct Query_
+		{
+			GLuint id = 0;
+			bool pending = false;
+			LoopState state = LoopState::active;
+			std::chrono::steady_clock::time_point begun;
+		};
+
+		void collect_();
+		UtilizationSample& sample_(LoopState) noexcept;
+
+		std::vector<Query_> mQueries;
+		std::size_t mNext = 0;
+		Query_* mCurrent = nullptr;
+
+		double mLastWall = -1.;
+		double mLastCpu = 0.;
+
+		UtilizationReport mTotals;
+};
+
+#endif // UTILIZATION_HPP_0993CB19_5FC7_4424_8EC6_C77249AB1D6A